@@ -0,0 +1,106 @@
+#!/bin/sh
+#
+# Times vmsbackup on synthetic savesets ("make bench").
+#
+#	sh bench.sh [vmsbackup]
+#
+# Makes, once, a corpus of savesets of different shapes with mksaveset in
+# $BENCHDIR (bench.d), then lists (-t), verifies (-t --crc verify) and
+# extracts (-x) each with the vmsbackup given (./vmsbackup) and prints the
+# best of $RUNS (3) runs of each in MB of saveset and files a second.  The
+# lines are the same from build to build, so two runs compare with diff
+# or paste:
+#
+#	sh bench.sh /tmp/old/vmsbackup > old; sh bench.sh > new; paste old new
+#
+# The times are wall clock, from date +%s%N (GNU date).
+
+VMSBACKUP=${1:-./vmsbackup}
+MKSAVESET=${MKSAVESET:-./mksaveset}
+BENCHDIR=${BENCHDIR:-bench.d}
+RUNS=${RUNS:-3}
+
+case $VMSBACKUP in
+/*)	;;
+*)	VMSBACKUP=`pwd`/$VMSBACKUP ;;
+esac
+
+mkdir -p $BENCHDIR || exit 1
+
+# name, then mksaveset arguments.
+corpus () {
+	name=$1
+	shift
+	if [ ! -f $BENCHDIR/$name ]
+	then
+		$MKSAVESET "$@" $BENCHDIR/$name > $BENCHDIR/$name.info || exit 1
+	fi
+}
+
+corpus small.bck -n 50000 -s 1024
+corpus text.bck -n 5000 -s 32768 -f VAR,VFC,STMLF
+corpus large.bck -n 16 -s 16777216 -f FIX
+corpus groups.bck -n 10000 -s 8192 -g 10
+corpus tape.tap -n 10000 -s 8192 -b 8192 -t
+
+now () {
+	date +%s%N
+}
+
+# The best time of $RUNS runs of the rest of the line, in nanoseconds;
+# the scratch directory is emptied before each.  Runs that fail do not
+# count, and if none succeeds it is FAILED.
+best () {
+	b=
+	i=0
+	while [ $i -lt $RUNS ]
+	do
+		rm -rf $BENCHDIR/x
+		mkdir $BENCHDIR/x
+		t0=`now`
+		if (cd $BENCHDIR/x && "$@" > /dev/null 2>&1)
+		then
+			t=$((`now` - t0))
+			if [ -z "$b" ] || [ $t -lt $b ]
+			then
+				b=$t
+			fi
+		else
+			echo "bench: failed: $*" >&2
+		fi
+		i=$((i + 1))
+	done
+	rm -rf $BENCHDIR/x
+	echo ${b:-FAILED}
+}
+
+printf "%-12s %-8s %9s %9s %11s\n" saveset op seconds MB/s files/s
+
+for s in small.bck text.bck large.bck groups.bck tape.tap
+do
+	bytes=`wc -c < $BENCHDIR/$s`
+	files=`cut -d' ' -f1 $BENCHDIR/$s.info`
+	f=../$s
+
+	for op in list verify extract
+	do
+		case $op in
+		list)	ns=`best $VMSBACKUP -t -f $f --crc skip` ;;
+		verify)	ns=`best $VMSBACKUP -t -f $f --crc verify` ;;
+		extract) ns=`best $VMSBACKUP -x -f $f` ;;
+		esac
+
+		if [ $ns = FAILED ]
+		then
+			printf "%-12s %-8s %9s %9s %11s\n" $s $op FAILED - -
+			continue
+		fi
+
+		awk -v s=$s -v op=$op -v ns=$ns -v bytes=$bytes -v files=$files 'BEGIN {
+			t = ns / 1e9
+			if (t <= 0)
+				t = 1e-9
+			printf "%-12s %-8s %9.3f %9.1f %11.0f\n", s, op, t, bytes / 1e6 / t, files / t
+			}'
+	done
+done
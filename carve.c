@@ -0,0 +1,501 @@
+/*
+ *
+ *  Title:
+ *	Carving savesets out of damaged images
+ *
+ *  Description:
+ *	A damaged image - a tape read with dropouts, bytes lost or
+ *	doubled, a disk copy with holes - loses the block boundaries, and
+ *	scan_bbh () can only find the next one by reading on 256 bytes at
+ *	a time.  Carving (--carve=map) instead looks at every byte offset
+ *	of the whole image for something that looks like a block header:
+ *
+ *	  - w_size is 256, l_blocksize the blocksize and w_applic 1 (data)
+ *	    or 2 (XOR), the name lengths are in range;
+ *
+ *	  - the block passes blk_check () (when the saveset has a CRC or
+ *	    header checksum, that leaves no doubt);
+ *
+ *	  - it does not overlap a block kept before it, and a data block
+ *	    has a higher l_number than the data block before it.
+ *
+ *	The image is cut in chunks which a few threads take in turn; the
+ *	search for the blocksize field is done with memchr (), which the C
+ *	library does a machine word or vector at a time.
+ *
+ *	The blocks found go to a block map, a text file with the offset,
+ *	number and kind of each block (and comments for the gaps), which
+ *	can be looked at and edited.  With --blockmap=map, vmsbackup ()
+ *	lists or extracts from the blocks in the map only.
+ *
+ */
+
+#ifdef HAVE_UNIXIO_H
+#include	<unixio.h>
+#else
+#include	<unistd.h>
+#include	<fcntl.h>
+#endif
+
+#include	<stdio.h>
+#include	<errno.h>
+#include	<stdlib.h>
+#include	<string.h>
+
+#include	<sys/types.h>
+#include	<sys/stat.h>
+#ifndef	NO_THREADS
+#include	<pthread.h>
+#endif
+
+#include	"vmsbackup.h"
+
+/* Bytes of the image each thread takes at a time.  */
+#define	CV_CHUNK	(4 << 20)
+
+/* Most threads we carve with.  */
+#define	CV_MAXTHREADS	16
+
+/* Offsets in the block header (BCK_BLK_HDR in vmsbackup.c).  */
+#define	BBH_W_SIZE	0
+#define	BBH_W_APPLIC	6
+#define	BBH_L_NUMBER	8
+#define	BBH_L_CRC	36
+#define	BBH_L_BLOCKSIZE	40
+#define	BBH_T_SSNAME	48
+#define	BBH_T_FILENAME	92
+
+#define	CV_UW(p)	((p) [0] | (p) [1] << 8)
+#define	CV_UL(p)	((p) [0] | (p) [1] << 8 | (p) [2] << 16 | (unsigned) (p) [3] << 24)
+
+typedef struct __cv_blk {
+	off_t		off;
+	unsigned	number;
+	int		applic;		/* 1 data, 2 XOR */
+	int		crc;		/* nonzero if it has a CRC */
+} CV_BLK;
+
+/* What the threads share.  */
+static int	cv_fd;
+static off_t	cv_size;
+static off_t	cv_next;		/* next chunk to take */
+static CV_BLK	*cv_blk;		/* candidates found so far */
+static int	cv_nblk, cv_alloc;
+static unsigned long	cv_rejected;
+static int	cv_err;
+
+#ifndef	NO_THREADS
+static pthread_mutex_t	cv_lock = PTHREAD_MUTEX_INITIALIZER;
+#define	CV_LOCK()	pthread_mutex_lock (&cv_lock)
+#define	CV_UNLOCK()	pthread_mutex_unlock (&cv_lock)
+#else
+#define	CV_LOCK()
+#define	CV_UNLOCK()
+#endif
+
+/*
+ *  Is there a block at P, whose size and blocksize fields are right?
+ */
+static int	cv_isblock	(
+		unsigned char *	p
+			)
+{
+int	applic;
+
+	applic = CV_UW (p + BBH_W_APPLIC);
+
+	if ( applic != 1 && applic != 2 )
+		return	0;
+
+	if ( p [BBH_T_SSNAME] > 31 || p [BBH_T_FILENAME] > 127 )
+		return	0;
+
+	return	!blk_check (p, blocksize);
+}
+
+/*
+ *  Add the candidates of a chunk to the list.
+ */
+static void	cv_add	(
+		CV_BLK *	bp,
+		int		n,
+		unsigned long	rejected
+			)
+{
+CV_BLK	*p;
+
+	CV_LOCK ();
+
+	cv_rejected += rejected;
+
+	if ( cv_nblk + n > cv_alloc )
+		{
+		if ( !(p = realloc (cv_blk, (cv_nblk + n + 1024) * sizeof (CV_BLK))) )
+			{
+			cv_err = ENOMEM;
+			CV_UNLOCK ();
+			return;
+			}
+
+		cv_blk = p;
+		cv_alloc = cv_nblk + n + 1024;
+		}
+
+	memcpy (cv_blk + cv_nblk, bp, n * sizeof (CV_BLK));
+	cv_nblk += n;
+
+	CV_UNLOCK ();
+}
+
+/*
+ *  Carving thread: take chunks and look for blocks starting in them.
+ */
+static void *	cv_worker	(
+		void *	arg
+			)
+{
+unsigned char	*buf, *p, *q, *end, key [4];
+CV_BLK	*found = NULL, *tmp;
+int	nfound, alloc = 0, k;
+unsigned long	rejected;
+off_t	start;
+ssize_t	len;
+
+	if ( !(buf = malloc (CV_CHUNK + blocksize)) )
+		{
+		cv_err = ENOMEM;
+		return	NULL;
+		}
+
+	/* We look for the least common byte of the blocksize field:
+	   the first one that is not zero.  */
+	key [0] = blocksize;
+	key [1] = blocksize >> 8;
+	key [2] = blocksize >> 16;
+	key [3] = blocksize >> 24;
+
+	for (k = 0; k < 3 && !key [k]; k++)
+		;
+
+	for (;;)
+		{
+		CV_LOCK ();
+		start = cv_next;
+		cv_next += CV_CHUNK;
+		CV_UNLOCK ();
+
+		if ( start >= cv_size || cv_err )
+			break;
+
+		/* The chunk and the block which may start at its end.  */
+		if ( 0 > (len = pread (cv_fd, buf, CV_CHUNK + blocksize, start)) )
+			{
+			cv_err = errno;
+			break;
+			}
+
+		nfound = 0;
+		rejected = 0;
+		p = buf + BBH_L_BLOCKSIZE + k;
+		end = buf + BBH_L_BLOCKSIZE + k + (len < CV_CHUNK ? len : CV_CHUNK);
+
+		if ( end > buf + len )
+			end = buf + len;
+
+		while ( p < end && (q = memchr (p, key [k], end - p)) )
+			{
+			p = q + 1;
+			q -= BBH_L_BLOCKSIZE + k;
+
+			/* A block cut off by the end of the image is no use.  */
+			if ( buf + len - q < blocksize
+				|| CV_UL (q + BBH_L_BLOCKSIZE) != (unsigned) blocksize
+				|| CV_UW (q + BBH_W_SIZE) != 256 )
+				continue;
+
+			if ( !cv_isblock (q) )
+				{
+				rejected++;
+				continue;
+				}
+
+			if ( nfound == alloc )
+				{
+				if ( !(tmp = realloc (found, (alloc + 256) * sizeof (CV_BLK))) )
+					{
+					cv_err = ENOMEM;
+					break;
+					}
+
+				found = tmp;
+				alloc += 256;
+				}
+
+			found [nfound].off = start + (q - buf);
+			found [nfound].number = CV_UL (q + BBH_L_NUMBER);
+			found [nfound].applic = CV_UW (q + BBH_W_APPLIC);
+			found [nfound].crc = CV_UL (q + BBH_L_CRC) != 0;
+			nfound++;
+
+			/* No other block can start inside this one.  */
+			if ( found [nfound - 1].crc )
+				p = q + blocksize + BBH_L_BLOCKSIZE + k;
+			}
+
+		cv_add (found, nfound, rejected);
+		}
+
+	free (found);
+	free (buf);
+
+	return	NULL;
+}
+
+static int	cv_cmp	(
+		const void *	a,
+		const void *	b
+			)
+{
+off_t	x = ((CV_BLK *) a)->off, y = ((CV_BLK *) b)->off;
+
+	return	x < y ? -1 : x > y;
+}
+
+/*
+ *  Keep the candidates which make a saveset: no overlaps (a block with
+ *  a CRC wins over one without) and data blocks in ascending order.
+ *  Returns the number kept, at the front of cv_blk.
+ */
+static int	cv_sequence	(void)
+{
+int	i, n = 0;
+unsigned	lastnum = 0;
+
+	qsort (cv_blk, cv_nblk, sizeof (CV_BLK), cv_cmp);
+
+	for (i = 0; i < cv_nblk; i++)
+		{
+		if ( n && cv_blk [i].off < cv_blk [n - 1].off + blocksize )
+			{
+			if ( cv_blk [n - 1].crc || !cv_blk [i].crc )
+				{
+				cv_rejected++;
+				continue;
+				}
+
+			/* Replace the one without a CRC.  */
+			cv_rejected++;
+			n--;
+			}
+
+		if ( cv_blk [i].applic == 1 && cv_blk [i].number )
+			{
+			if ( cv_blk [i].number <= lastnum )
+				{
+				if ( vflag )
+					fprintf (stderr, "[0x%08X] Block %u out of sequence, not used\n",
+						(unsigned) cv_blk [i].off, cv_blk [i].number);
+				cv_rejected++;
+				continue;
+				}
+
+			lastnum = cv_blk [i].number;
+			}
+
+		cv_blk [n++] = cv_blk [i];
+		}
+
+	return	n;
+}
+
+/*
+ *  Write the block map of the N blocks kept to MAP.
+ */
+static int	cv_write	(
+		char *	image,
+		char *	map,
+		int	n
+			)
+{
+FILE	*fp;
+int	i;
+unsigned	next = 1;
+
+	if ( !(fp = fopen (map, "w")) )
+		{
+		perror (map);
+		return	-1;
+		}
+
+	fprintf (fp, "# vmsbackup block map of %s\nblocksize %d\n", image, blocksize);
+
+	for (i = 0; i < n; i++)
+		{
+		if ( cv_blk [i].applic == 1 && cv_blk [i].number )
+			{
+			if ( cv_blk [i].number > next )
+				fprintf (fp, "# blocks %u to %u missing\n", next, cv_blk [i].number - 1);
+
+			next = cv_blk [i].number + 1;
+			}
+
+		fprintf (fp, "%llu %u %c\n", (unsigned long long) cv_blk [i].off,
+			cv_blk [i].number, cv_blk [i].applic == 2 ? 'X' : 'D');
+		}
+
+	if ( fclose (fp) )
+		{
+		perror (map);
+		return	-1;
+		}
+
+	return	0;
+}
+
+/*
+ *  Carve the image IMAGE open on FD with NJOBS threads (0: one per
+ *  processor) and write its block map to MAP.  Returns -1 on error.
+ */
+int	carve	(
+		char *	image,
+		int	fd,
+		char *	map,
+		int	njobs
+			)
+{
+struct stat	st;
+int	i, n, ndata = 0;
+#ifndef	NO_THREADS
+pthread_t	thread [CV_MAXTHREADS];
+#endif
+
+	if ( fstat (fd, &st) )
+		{
+		perror (image);
+		return	-1;
+		}
+
+	if ( njobs < 1 )
+		{
+#if	!defined (NO_THREADS) && defined (_SC_NPROCESSORS_ONLN)
+		njobs = sysconf (_SC_NPROCESSORS_ONLN);
+#else
+		njobs = 1;
+#endif
+		}
+
+	if ( njobs > CV_MAXTHREADS )
+		njobs = CV_MAXTHREADS;
+
+	cv_fd = fd;
+	cv_size = st.st_size;
+	cv_next = 0;
+
+	if ( vflag )
+		printf ("Carving %s, %llu bytes, with %d thread(s)\n", image,
+			(unsigned long long) cv_size, njobs);
+
+#ifndef	NO_THREADS
+	for (i = 1; i < njobs; i++)
+		if ( (errno = pthread_create (&thread [i], NULL, cv_worker, NULL)) )
+			{
+			perror ("carving thread");
+			exit (1);
+			}
+
+	cv_worker (NULL);
+
+	for (i = 1; i < njobs; i++)
+		pthread_join (thread [i], NULL);
+#else
+	cv_worker (NULL);
+#endif
+
+	if ( cv_err )
+		{
+		errno = cv_err;
+		perror (image);
+		return	-1;
+		}
+
+	n = cv_sequence ();
+
+	for (i = 0; i < n; i++)
+		if ( cv_blk [i].applic == 1 )
+			ndata++;
+
+	fprintf (stderr, "Carved %d data and %d XOR block(s) from %s, %lu candidate(s) rejected\n",
+		ndata, n - ndata, image, cv_rejected);
+
+	i = cv_write (image, map, n);
+
+	free (cv_blk);
+	cv_blk = NULL;
+	cv_nblk = cv_alloc = 0;
+
+	return	i;
+}
+
+/*
+ *  Read the block map MAP: the offsets of the blocks, in *OFFSP
+ *  (malloc ()ed).  Sets blocksize from it.  Returns the number of
+ *  blocks, -1 on error.
+ */
+int	map_load	(
+		char *	map,
+		off_t **	offsp
+			)
+{
+FILE	*fp;
+char	line [128];
+unsigned long long	off;
+off_t	*offs = NULL, *p;
+int	n = 0, alloc = 0, lineno = 0, bs;
+
+	if ( !(fp = fopen (map, "r")) )
+		{
+		perror (map);
+		return	-1;
+		}
+
+	while ( fgets (line, sizeof (line), fp) )
+		{
+		lineno++;
+
+		if ( line [0] == '#' || line [0] == '\n' )
+			continue;
+
+		if ( 1 == sscanf (line, "blocksize %d", &bs) )
+			{
+			blocksize = bs;
+			continue;
+			}
+
+		if ( 1 != sscanf (line, "%llu", &off) || (n && (off_t) off <= offs [n - 1]) )
+			{
+			fprintf (stderr, "%s:%d: bad block map entry\n", map, lineno);
+			fclose (fp);
+			free (offs);
+			return	-1;
+			}
+
+		if ( n == alloc )
+			{
+			if ( !(p = realloc (offs, (alloc + 1024) * sizeof (off_t))) )
+				{
+				fprintf (stderr, "out of memory\n");
+				exit (1);
+				}
+
+			offs = p;
+			alloc += 1024;
+			}
+
+		offs [n++] = off;
+		}
+
+	fclose (fp);
+	*offsp = offs;
+
+	return	n;
+}
@@ -0,0 +1,347 @@
+/*
+ *
+ *  Title:
+ *	Tape catalogue
+ *
+ *  Description:
+ *	Remembers where things are on a tape: for each saveset the tape
+ *	position of its header labels, and for each file the position of
+ *	the block holding its file record.  The catalogue is written the
+ *	first time a saveset is read all the way through (with -C file);
+ *	afterwards -s and named files are found by seeking straight to
+ *	these positions instead of spacing over file marks and reading
+ *	every block.
+ *
+ *	The catalogue is a text file:
+ *
+ *		VMSBACKUP-CATALOG 1
+ *		volume <volume label>
+ *		set <number> <position> <saveset name>
+ *		file <set number> <position> <file name>
+ *		end <set number>
+ *
+ *	where "end" marks a saveset whose file list is complete.
+ *
+ */
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<sys/types.h>
+
+#include	"vmsbackup.h"
+
+#define	CAT_MAGIC	"VMSBACKUP-CATALOG 1"
+
+typedef struct __cat_set {
+	int	setnr;
+	off_t	pos;
+	char	name [32];
+	int	complete;
+} CAT_SET;
+
+typedef struct __cat_file {
+	int	setnr;
+	off_t	pos;
+	char *	name;
+} CAT_FILE;
+
+static char	*cat_path;
+static char	cat_vol [16];
+static CAT_SET	*sets;
+static int	nsets, asets;
+static CAT_FILE	*files;
+static int	nfiles_cat, afiles;
+static int	dirty;
+
+static void *	cat_grow	(
+		void *	p,
+		int *	allocp,
+		int	n,
+		size_t	size
+			)
+{
+	if ( n < *allocp )
+		return	p;
+
+	*allocp = *allocp ? 2 * *allocp : 64;
+
+	if ( !(p = realloc (p, *allocp * size)) )
+		{
+		fprintf (stderr, "out of memory\n");
+		exit (1);
+		}
+
+	return	p;
+}
+
+static CAT_SET *	cat_findset	(
+		int	setnr
+			)
+{
+int	i;
+
+	for (i = 0; i < nsets; i++)
+		if ( sets [i].setnr == setnr )
+			return	&sets [i];
+
+	return	NULL;
+}
+
+/*
+ *  Forget what we know about saveset SETNR (and its files).
+ */
+static void	cat_dropset	(
+		int	setnr
+			)
+{
+int	i, j;
+
+	for (i = j = 0; i < nfiles_cat; i++)
+		if ( files [i].setnr == setnr )
+			free (files [i].name);
+		else	files [j++] = files [i];
+
+	nfiles_cat = j;
+
+	for (i = j = 0; i < nsets; i++)
+		if ( sets [i].setnr != setnr )
+			sets [j++] = sets [i];
+
+	nsets = j;
+}
+
+/*
+ *  Read the catalogue from PATH, if it exists.  Returns -1 if it exists
+ *  but is not a catalogue.
+ */
+int	cat_load	(
+		char *	path
+			)
+{
+FILE	*fp;
+char	line [512], name [256];
+long long	pos;
+int	setnr;
+CAT_SET	*sp;
+
+	cat_path = path;
+
+	if ( !(fp = fopen (path, "r")) )
+		return	0;
+
+	if ( !fgets (line, sizeof (line), fp) || strncmp (line, CAT_MAGIC, strlen (CAT_MAGIC)) )
+		{
+		fprintf (stderr, "%s: not a vmsbackup tape catalogue\n", path);
+		fclose (fp);
+		cat_path = NULL;
+		return	-1;
+		}
+
+	while ( fgets (line, sizeof (line), fp) )
+		{
+		if ( 1 == sscanf (line, "volume %15s", cat_vol) )
+			continue;
+
+		if ( 3 == sscanf (line, "set %d %lld %31s", &setnr, &pos, name) )
+			{
+			sets = cat_grow (sets, &asets, nsets, sizeof (CAT_SET));
+			sp = &sets [nsets++];
+			memset (sp, 0, sizeof (CAT_SET));
+			sp->setnr = setnr;
+			sp->pos = pos;
+			strcpy (sp->name, name);
+			continue;
+			}
+
+		if ( 3 == sscanf (line, "file %d %lld %255s", &setnr, &pos, name) )
+			{
+			files = cat_grow (files, &afiles, nfiles_cat, sizeof (CAT_FILE));
+			files [nfiles_cat].setnr = setnr;
+			files [nfiles_cat].pos = pos;
+			files [nfiles_cat].name = strdup (name);
+			nfiles_cat++;
+			continue;
+			}
+
+		if ( 1 == sscanf (line, "end %d", &setnr) && (sp = cat_findset (setnr)) )
+			sp->complete = 1;
+		}
+
+	fclose (fp);
+
+	return	0;
+}
+
+/*
+ *  Check the catalogue is for the tape whose volume label is VOL.  If it
+ *  is for another tape we start a fresh one.
+ */
+void	cat_volume	(
+		char *	vol
+			)
+{
+	if ( !cat_path )
+		return;
+
+	if ( *cat_vol && strcmp (cat_vol, vol) )
+		{
+		fprintf (stderr, "%s: catalogue is for volume %s, not %s; rebuilding it\n",
+			cat_path, cat_vol, vol);
+
+		while ( nsets )
+			cat_dropset (sets [0].setnr);
+		}
+
+	if ( strcmp (cat_vol, vol) )
+		{
+		strncpy (cat_vol, vol, sizeof (cat_vol) - 1);
+		dirty = 1;
+		}
+}
+
+/*
+ *  Tape position of the labels of saveset SETNR, or -1 if unknown.
+ */
+off_t	cat_setpos	(
+		int	setnr
+			)
+{
+CAT_SET	*sp;
+
+	return	cat_path && (sp = cat_findset (setnr)) ? sp->pos : -1;
+}
+
+/*
+ *  Nonzero if we have the full list of files in saveset SETNR.
+ */
+int	cat_complete	(
+		int	setnr
+			)
+{
+CAT_SET	*sp;
+
+	return	cat_path && (sp = cat_findset (setnr)) && sp->complete;
+}
+
+/*
+ *  Get the files of saveset SETNR one after another: *ITER starts at 0.
+ *  Returns 0 at the end.
+ */
+int	cat_nextfile	(
+		int	setnr,
+		int *	iter,
+		off_t *	posp,
+		char **	namep
+			)
+{
+	for ( ; *iter < nfiles_cat; ++*iter)
+		if ( files [*iter].setnr == setnr )
+			{
+			*posp = files [*iter].pos;
+			*namep = files [(*iter)++].name;
+			return	1;
+			}
+
+	return	0;
+}
+
+/*
+ *  We are about to read saveset SETNR, NAME, whose labels are at tape
+ *  position POS, from the beginning: start recording it.
+ */
+void	cat_addset	(
+		int	setnr,
+		char *	name,
+		off_t	pos
+			)
+{
+CAT_SET	*sp;
+
+	if ( !cat_path || pos < 0 )
+		return;
+
+	cat_dropset (setnr);
+
+	sets = cat_grow (sets, &asets, nsets, sizeof (CAT_SET));
+	sp = &sets [nsets++];
+	memset (sp, 0, sizeof (CAT_SET));
+	sp->setnr = setnr;
+	sp->pos = pos;
+	strncpy (sp->name, name, sizeof (sp->name) - 1);
+
+	dirty = 1;
+}
+
+/*
+ *  Record that the file record of NAME is in the block at tape position
+ *  POS of saveset SETNR.
+ */
+void	cat_addfile	(
+		int	setnr,
+		off_t	pos,
+		char *	name
+			)
+{
+	if ( !cat_path || pos < 0 )
+		return;
+
+	files = cat_grow (files, &afiles, nfiles_cat, sizeof (CAT_FILE));
+	files [nfiles_cat].setnr = setnr;
+	files [nfiles_cat].pos = pos;
+	files [nfiles_cat].name = strdup (name);
+	nfiles_cat++;
+}
+
+/*
+ *  Saveset SETNR has been read up to its trailing file mark.
+ */
+void	cat_endset	(
+		int	setnr
+			)
+{
+CAT_SET	*sp;
+
+	if ( cat_path && (sp = cat_findset (setnr)) )
+		sp->complete = 1;
+}
+
+/*
+ *  Write the catalogue back if we learned anything.  Savesets we did not
+ *  read to the end are left out.
+ */
+void	cat_save	(void)
+{
+FILE	*fp;
+int	i;
+
+	if ( !cat_path || !dirty )
+		return;
+
+	if ( !(fp = fopen (cat_path, "w")) )
+		{
+		perror (cat_path);
+		return;
+		}
+
+	fprintf (fp, "%s\nvolume %s\n", CAT_MAGIC, cat_vol);
+
+	for (i = 0; i < nsets; i++)
+		if ( sets [i].complete )
+			fprintf (fp, "set %d %lld %s\n", sets [i].setnr,
+				(long long) sets [i].pos, *sets [i].name ? sets [i].name : "-");
+
+	for (i = 0; i < nfiles_cat; i++)
+		if ( cat_complete (files [i].setnr) )
+			fprintf (fp, "file %d %lld %s\n", files [i].setnr,
+				(long long) files [i].pos, files [i].name);
+
+	for (i = 0; i < nsets; i++)
+		if ( sets [i].complete )
+			fprintf (fp, "end %d\n", sets [i].setnr);
+
+	if ( fclose (fp) )
+		perror (cat_path);
+
+	dirty = 0;
+}
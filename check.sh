@@ -0,0 +1,135 @@
+#!/bin/sh
+#
+# Checks that vmsbackup extracts the same files with -j as without it
+# ("make check").
+#
+#	sh check.sh [vmsbackup]
+#
+# First crccheck checks the block CRC and header checksum against known
+# answers (see crccheck.c).
+#
+# With -j the data of fixed and stream files, and of all files with -B,
+# is written at its place in the file by several threads; without it the
+# VBN records are converted one after another.  For each record format
+# mksaveset makes a saveset in $CHECKDIR (check.d), with block sizes and
+# record lengths such that records and their counts and VFC control areas
+# are split across VBN records and blocks, and the files extracted with
+# -x and -x -j 3, and with -x -B and -x -B -j 3, must be the same.  Each
+# vmsbackup must succeed, and the one without -j must give as many files
+# as mksaveset wrote, so that a saveset it cannot read does not pass with
+# nothing to compare.
+#
+# Then two data blocks of one redundancy group are spoiled, too many to
+# rebuild: with --crc warn (the default) every file must still come out,
+# the same size as from the good saveset, with and without -j.  The exit
+# status is 1 if any of this is not so.
+
+VMSBACKUP=${1:-./vmsbackup}
+MKSAVESET=${MKSAVESET:-./mksaveset}
+CRCCHECK=${CRCCHECK:-./crccheck}
+CHECKDIR=${CHECKDIR:-check.d}
+failed=0
+
+case $VMSBACKUP in
+/*)	;;
+*)	VMSBACKUP=`pwd`/$VMSBACKUP ;;
+esac
+
+case $CHECKDIR in
+/*)	;;
+*)	CHECKDIR=`pwd`/$CHECKDIR ;;
+esac
+
+$CRCCHECK || failed=1
+
+rm -rf $CHECKDIR
+mkdir -p $CHECKDIR || exit 1
+
+for f in FIX VAR VFC STM STMLF STMCR FIX,VAR,VFC,STM,STMLF,STMCR
+do
+	for b in 2048 32256
+	do
+		s=$CHECKDIR/$f.$b.bck
+		$MKSAVESET -n 200 -s 20000 -b $b -f $f -S $b $s > $s.info || exit 1
+		files=`cut -d' ' -f1 $s.info`
+
+		for B in "" -B
+		do
+			ok=1
+
+			for j in 1 3
+			do
+				rm -rf $CHECKDIR/j$j
+				mkdir $CHECKDIR/j$j
+
+				if ! (cd $CHECKDIR/j$j && $VMSBACKUP -x $B -b $b -j $j -f $s > /dev/null 2>&1)
+				then
+					echo "check: $VMSBACKUP -x $B -b $b -j $j -f $s failed"
+					ok=0
+				fi
+			done
+
+			n=`find $CHECKDIR/j1 -type f | wc -l`
+
+			if [ $n -ne $files ]
+			then
+				echo "FAILED $f, blocksize $b, -x $B: $n files of $files"
+				failed=1
+			elif [ $ok = 0 ]
+			then
+				echo "FAILED $f, blocksize $b, -x $B: vmsbackup failed"
+				failed=1
+			elif diff -r $CHECKDIR/j1 $CHECKDIR/j3 > /dev/null
+			then
+				echo "ok     $f, blocksize $b, -x $B"
+			else
+				echo "FAILED $f, blocksize $b, -x $B: -j 3 differs"
+				failed=1
+			fi
+		done
+	done
+done
+
+# Data blocks 3 and 5, of the first group of 10: a byte pattern
+# half-way through each.
+b=8192
+s=$CHECKDIR/bad.bck
+$MKSAVESET -n 40 -s 20000 -b $b -g 10 -f FIX -S 8 $s > $s.info || exit 1
+files=`cut -d' ' -f1 $s.info`
+
+rm -rf $CHECKDIR/good
+mkdir $CHECKDIR/good
+(cd $CHECKDIR/good && $VMSBACKUP -x -b $b -f $s > /dev/null 2>&1) || echo "check: $VMSBACKUP -x -b $b -f $s failed"
+
+for k in 2 4
+do
+	printf '\125\252\125\252\125\252\125\252' |
+		dd of=$s bs=1 seek=$((k * b + 4000)) conv=notrunc 2> /dev/null || exit 1
+done
+
+for j in 1 3
+do
+	rm -rf $CHECKDIR/j$j
+	mkdir $CHECKDIR/j$j
+	(cd $CHECKDIR/j$j && $VMSBACKUP -x -b $b -j $j -f $s > /dev/null 2>&1) ||
+		echo "check: $VMSBACKUP -x -b $b -j $j -f $s failed"
+
+	# Names and sizes.
+	for d in good j$j
+	do
+		(cd $CHECKDIR/$d && find . -type f -exec wc -c {} + | sort) > $CHECKDIR/$d.ls
+	done
+
+	n=`find $CHECKDIR/j$j -type f | wc -l`
+
+	if [ $n -eq $files ] && cmp -s $CHECKDIR/good.ls $CHECKDIR/j$j.ls
+	then
+		echo "ok     two bad blocks in a group, -x -j $j"
+	else
+		echo "FAILED two bad blocks in a group, -x -j $j: $n files of $files, or not the same sizes"
+		failed=1
+	fi
+done
+
+rm -rf $CHECKDIR
+exit $failed
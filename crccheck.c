@@ -0,0 +1,104 @@
+/*
+ *
+ *  Title:
+ *	Block check known answers
+ *
+ *  Description:
+ *	Checks crc.c against values it did not make itself ("make check"
+ *	runs it), since mksaveset writes its blocks with the same code and
+ *	a saveset of its would pass whatever crc.c did:
+ *
+ *	  the CRC-32 check value, 0xcbf43926 for "123456789", which holds
+ *	  the polynomial (0xedb88320, bit reversed), the initial value
+ *	  (all ones) and the final complement;
+ *
+ *	  a 512 byte block made up below, whose l_crc and w_checksum were
+ *	  worked out apart from this code (with zlib's crc32 and a bit at a
+ *	  time CRC, and a sum of the header words): the CRC of all of the
+ *	  block with l_crc zero, the checksum of the first 127 words with
+ *	  l_crc zero;
+ *
+ *	  the same block with a byte of data or of the header changed,
+ *	  which must fail the CRC, and the checksum as well for the header.
+ *
+ *	Prints a line a check, and exits 1 if any fails.
+ *
+ */
+
+#include	<stdio.h>
+#include	<string.h>
+
+#include	<sys/types.h>
+
+#include	"vmsbackup.h"
+
+#define	CK_BLKSZ	512
+#define	CK_CRC		0x0b85d63bU	/* l_crc of the block */
+#define	CK_CHECKSUM	0x9efc		/* w_checksum of the block */
+
+static int	failed;
+
+static void	ck_report	(
+		const char *	what,
+		int		ok
+			)
+{
+	printf ("%s %s\n", ok ? "ok    " : "FAILED", what);
+
+	if ( !ok )
+		failed = 1;
+}
+
+/*
+ *  The block: bytes 7 * i + 3, with a header size of 256, then its
+ *  checksum and CRC.
+ */
+static void	ck_block	(
+		unsigned char *	blk
+			)
+{
+int	i;
+
+	for (i = 0; i < CK_BLKSZ; i++)
+		blk [i] = i * 7 + 3;
+
+	blk [0] = 0;
+	blk [1] = 1;
+	memset (blk + 36, 0, 4);
+
+	blk [254] = CK_CHECKSUM & 0xff;
+	blk [255] = CK_CHECKSUM >> 8;
+
+	for (i = 0; i < 4; i++)
+		blk [36 + i] = CK_CRC >> 8 * i;
+}
+
+int	main	(void)
+{
+unsigned char	blk [CK_BLKSZ];
+
+	crc_init ();
+
+	ck_report ("CRC-32 of \"123456789\" is 0xcbf43926",
+		~crc32_update (0xffffffff, (unsigned char *) "123456789", 9) == 0xcbf43926U);
+
+	ck_block (blk);
+	ck_report ("known block passes", blk_check (blk, CK_BLKSZ) == 0);
+
+	blk [300] ^= 0x01;
+	ck_report ("a data byte changed fails the CRC only", blk_check (blk, CK_BLKSZ) == BLK_M_CRC);
+
+	ck_block (blk);
+	blk [100] ^= 0x01;
+	ck_report ("a header byte changed fails both",
+		blk_check (blk, CK_BLKSZ) == (BLK_M_CRC | BLK_M_CHECKSUM));
+
+	/* No CRC and no checksum in the saveset: nothing to fail.  */
+	ck_block (blk);
+	blk [300] ^= 0x01;
+	memset (blk + 36, 0, 4);
+	memset (blk + 254, 0, 2);
+	ck_report ("a block with neither is not checked", blk_check (blk, CK_BLKSZ) == 0);
+
+	return	failed;
+}
@@ -0,0 +1,290 @@
+/*
+ *
+ *  Title:
+ *	Output directory cache
+ *
+ *  Description:
+ *	With -d every file goes to the directory named by the directory
+ *	part of its VMS name.  Instead of a mkdir () of each prefix of
+ *	that path and an open () by full path for every file, the
+ *	directories are kept in a hash table by their (Unix) path, with a
+ *	descriptor open on each: a directory is made once, when it is
+ *	first seen, from the descriptor of its parent, and files are
+ *	opened with openat () relative to the descriptor of theirs.
+ *
+ *	Savesets list files directory by directory, so few directories
+ *	are in use at a time; when too many descriptors are open, they
+ *	are all closed and the ones needed again reopened from their
+ *	parents.  The directories stay in the table, known to exist.
+ *
+ */
+
+#ifdef HAVE_UNIXIO_H
+#include	<unixio.h>
+#else
+#include	<unistd.h>
+#include	<fcntl.h>
+#endif
+
+#include	<stdio.h>
+#include	<errno.h>
+#include	<stdlib.h>
+#include	<string.h>
+
+#include	<sys/types.h>
+#include	<sys/stat.h>
+
+#include	"vmsbackup.h"
+
+#if	defined (NO_OPENAT) && !defined (__vax)
+/* The help claims that mkdir is declared in stdlib.h but it doesn't
+   seem to be true.  AXP/VMS 6.2, DECC ?.?.  On the other hand, VAX/VMS 6.2
+   seems to declare it in a way which conflicts with this definition.
+   This is starting to sound like a bad dream.  */
+int mkdir ();
+#endif
+
+#ifndef	NO_OPENAT
+
+/* Most descriptors we keep open.  */
+#define	DC_MAXOPEN	128
+
+typedef struct __dc_ent {
+	char *		path;		/* NULL: free slot */
+	unsigned	hash;
+	int		fd;		/* -1: not open now */
+} DC_ENT;
+
+static DC_ENT	*dc_tab;
+static unsigned	dc_size, dc_used;
+static int	dc_nopen;
+
+static unsigned	dc_hash	(
+		char *	p,
+		size_t	len
+			)
+{
+unsigned	h = 2166136261u;
+
+	while ( len-- )
+		h = (h ^ (unsigned char) *p++) * 16777619u;
+
+	return	h;
+}
+
+/*
+ *  The slot for the LEN byte path P with hash H: its entry, or the free
+ *  slot it would go into.
+ */
+static DC_ENT *	dc_slot	(
+		char *		p,
+		size_t		len,
+		unsigned	h
+			)
+{
+DC_ENT	*ep;
+
+	for (ep = dc_tab + (h & (dc_size - 1)); ep->path; )
+		{
+		if ( ep->hash == h && !strncmp (ep->path, p, len) && !ep->path [len] )
+			break;
+
+		if ( ++ep == dc_tab + dc_size )
+			ep = dc_tab;
+		}
+
+	return	ep;
+}
+
+/*
+ *  Make room for one more entry: the table is kept at most half full.
+ */
+static void	dc_grow	(void)
+{
+DC_ENT	*old = dc_tab, *ep;
+unsigned	i, n = dc_size;
+
+	if ( 2 * (dc_used + 1) <= dc_size )
+		return;
+
+	dc_size = n ? 2 * n : 256;
+
+	if ( !(dc_tab = calloc (dc_size, sizeof (DC_ENT))) )
+		{
+		fprintf (stderr, "out of memory\n");
+		exit (1);
+		}
+
+	for (i = 0; i < n; i++)
+		if ( old [i].path )
+			{
+			for (ep = dc_tab + (old [i].hash & (dc_size - 1)); ep->path; )
+				if ( ++ep == dc_tab + dc_size )
+					ep = dc_tab;
+
+			*ep = old [i];
+			}
+
+	free (old);
+}
+
+/*
+ *  Close all the descriptors, keeping the directories.
+ */
+static void	dc_closeall	(void)
+{
+unsigned	i;
+
+	for (i = 0; i < dc_size; i++)
+		if ( dc_tab [i].path && dc_tab [i].fd >= 0 )
+			{
+			close (dc_tab [i].fd);
+			dc_tab [i].fd = -1;
+			}
+
+	dc_nopen = 0;
+}
+
+/*
+ *  A descriptor open on the directory of the LEN byte path P, relative
+ *  to the current directory, which is made if need be (with its
+ *  parents), or AT_FDCWD for the current directory.  Returns -1 on
+ *  error, with errno set.
+ */
+static int	dc_dir	(
+		char *	p,
+		size_t	len
+			)
+{
+DC_ENT	*ep;
+char	*name;
+unsigned	h;
+int	pfd, fd;
+size_t	plen;
+
+	if ( !len )
+		return	AT_FDCWD;
+
+	dc_grow ();
+
+	h = dc_hash (p, len);
+	ep = dc_slot (p, len, h);
+
+	if ( ep->path && ep->fd >= 0 )
+		return	ep->fd;
+
+	/* The parent, then this one in it ("a//b" is "a/b").  */
+	for (plen = len; plen && p [plen - 1] != '/'; plen--)
+		;
+
+	if ( plen == len )
+		return	dc_dir (p, len - 1);
+
+	if ( -1 == (pfd = dc_dir (p, plen ? plen - 1 : 0)) )
+		return	-1;
+
+	/* The parent may have grown the table.  */
+	ep = dc_slot (p, len, h);
+
+	if ( !(name = malloc (len + 1)) )
+		{
+		fprintf (stderr, "out of memory\n");
+		exit (1);
+		}
+
+	memcpy (name, p, len);
+	name [len] = '\0';
+
+	if ( !ep->path && mkdirat (pfd, name + plen, 0777) && errno != EEXIST )
+		{
+		free (name);
+		return	-1;
+		}
+
+	if ( 0 > (fd = openat (pfd, name + plen, O_RDONLY | O_DIRECTORY)) )
+		{
+		free (name);
+		return	-1;
+		}
+
+	if ( dc_nopen >= DC_MAXOPEN )
+		{
+		/* Our parent's descriptor goes too: we are done with it.  */
+		dc_closeall ();
+		ep = dc_slot (p, len, h);
+		}
+
+	if ( ep->path )
+		free (name);
+	else	{
+		ep->path = name;
+		ep->hash = h;
+		dc_used++;
+		}
+
+	ep->fd = fd;
+	dc_nopen++;
+
+	return	fd;
+}
+
+#endif
+
+/*
+ *  Open the file PATH, relative to the current directory, for writing,
+ *  making its directories if they are not there.
+ */
+FILE *	dir_fopen	(
+		char *	path
+			)
+{
+#ifndef	NO_OPENAT
+char	*name;
+int	dfd, fd;
+FILE	*fp;
+
+	if ( (name = strrchr (path, '/')) )
+		name++;
+	else	name = path;
+
+	if ( -1 == (dfd = dc_dir (path, name > path ? name - path - 1 : 0)) )
+		return	NULL;
+
+	if ( 0 > (fd = openat (dfd, name, O_WRONLY | O_CREAT | O_TRUNC, 0666)) )
+		return	NULL;
+
+	if ( !(fp = fdopen (fd, "w")) )
+		close (fd);
+
+	return	fp;
+#else
+char	*p;
+
+	for (p = path; (p = strchr (p, '/')); *p++ = '/')
+		{
+		*p = '\0';
+		mkdir (path, 0777);
+		}
+
+	return	fopen (path, "w");
+#endif
+}
+
+/*
+ *  Done with the directories.
+ */
+void	dir_close	(void)
+{
+#ifndef	NO_OPENAT
+unsigned	i;
+
+	dc_closeall ();
+
+	for (i = 0; i < dc_size; i++)
+		free (dc_tab [i].path);
+
+	free (dc_tab);
+	dc_tab = NULL;
+	dc_size = dc_used = 0;
+#endif
+}
@@ -0,0 +1,537 @@
+/*
+ *
+ *  Title:
+ *	Parallel extraction
+ *
+ *  Description:
+ *	Extraction of a saveset on disk by several threads (-j).  A VBN
+ *	record carries the virtual block number its data starts at
+ *	(BCK_REC_HDR.l_address), so whenever the output is the data byte
+ *	for byte - fixed length and stream files, and variable length
+ *	ones in binary mode - it can go straight to offset
+ *	(l_address - 1) * 512 of the output with pwrite (), in any order.
+ *
+ *	The saveset is taken a window of blocks at a time:
+ *
+ *	  - each thread reads its own range of blocks of the window and
+ *	    lists the records in them;
+ *
+ *	  - the main thread then goes through all these records in saveset
+ *	    order, as process_block () would: summary and file records go
+ *	    to process_summary () and process_file () (so listing, file
+ *	    selection and opening the output work as always) and VBN
+ *	    records of files which cannot be written positionally go to
+ *	    process_vbn ().  The other VBN records are tagged with the
+ *	    output of the file they belong to, which may have been opened
+ *	    in an earlier range or window;
+ *
+ *	  - each thread writes the tagged records of its range.
+ *
+ *	A block we cannot make sense of ends the parallel run, and
+ *	vmsbackup () carries on from that block the usual way (and
+ *	resynchronizes, see scan_bbh ()).  So does a block failing its
+ *	CRC in a saveset with redundancy groups, to be rebuilt there.
+ *
+ */
+
+#ifdef HAVE_UNIXIO_H
+#include	<unixio.h>
+#else
+#include	<unistd.h>
+#include	<fcntl.h>
+#endif
+
+#include	<stdio.h>
+#include	<errno.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<time.h>
+
+#include	<sys/types.h>
+#ifndef	NO_UTIMENS
+#include	<sys/stat.h>
+#endif
+#ifndef	NO_THREADS
+#include	<pthread.h>
+#endif
+
+#include	"vmsbackup.h"
+
+#ifndef	MIN
+#define	MIN(a, b)	((a) < (b) ? (a) : (b))
+#endif
+
+#ifndef	NO_THREADS
+
+/* Blocks each thread takes of a window.  */
+#define	XP_BLOCKS	64
+
+#define	XP_K_SUMMARY	1
+#define	XP_K_FILE	3
+#define	XP_K_VBN	4
+#define	XP_K_BADBLK	-1		/* block failing blk_check () */
+#define	XP_K_BLOCK	-2		/* start of a block; vbn is l_number */
+
+typedef struct __xp_rec {
+	int		type;
+	int		off;		/* record data, in the window buffer */
+	int		len;
+	unsigned	vbn;
+
+	/* Filled in by the main thread for VBN records to be written.  */
+	int		fd;		/* -1: nothing to write */
+	int		cr;		/* Stream_CR in text mode: CR -> LF */
+	int		size;		/* size of the output file */
+} XP_REC;
+
+typedef struct __xp_job {
+	pthread_t	thread;
+	int		fd;
+	char *		win;		/* the window buffer */
+	int		first,		/* blocks of the window we read */
+			nblk;
+	off_t		winoff;		/* saveset offset of the window */
+
+	int		got;		/* blocks we did read */
+	int		bad;		/* first block we cannot decode, or -1 */
+
+	XP_REC *	rec;
+	int		nrec,
+			arec;
+	int		err;		/* errno of a failed read or write */
+} XP_JOB;
+
+static int	xp_pass;		/* 1: read and list, 2: write */
+
+static void	xp_addrec	(
+		XP_JOB *	jp,
+		int		type,
+		int		off,
+		int		len,
+		unsigned	vbn
+			)
+{
+XP_REC	*rp;
+
+	if ( jp->nrec == jp->arec )
+		{
+		jp->arec = jp->arec ? 2 * jp->arec : 1024;
+
+		if ( !(jp->rec = realloc (jp->rec, jp->arec * sizeof (XP_REC))) )
+			{
+			fprintf (stderr, "out of memory\n");
+			exit (1);
+			}
+		}
+
+	rp = &jp->rec [jp->nrec++];
+	rp->type = type;
+	rp->off = off;
+	rp->len = len;
+	rp->vbn = vbn;
+	rp->fd = -1;
+}
+
+/*
+ *  List the records of block N of the window; returns 0 if the block is
+ *  not one process_block () would decode without complaint.  The checks
+ *  are the same as there.
+ */
+static int	xp_scan	(
+		XP_JOB *	jp,
+		int		n
+			)
+{
+unsigned char	*bp = (unsigned char *) jp->win + (size_t) n * blocksize;
+unsigned	bsize, i, rsize, rtype;
+
+	if ( (bp [0] | bp [1] << 8) != 256 )
+		return	0;
+
+	bsize = bp [40] | bp [41] << 8 | bp [42] << 16 | (unsigned) bp [43] << 24;
+
+	if ( bsize && bsize != blocksize )
+		return	0;
+
+	/* The main thread reports it, and decides whether to use it.  */
+	if ( crcmode != CRC_K_SKIP && blk_check (bp, blocksize) )
+		xp_addrec (jp, XP_K_BADBLK, n * blocksize, blocksize, 0);
+
+	/* For the redundancy group and duplicate checks; the data of
+	   XOR blocks is not records.  */
+	xp_addrec (jp, XP_K_BLOCK, n * blocksize, blocksize,
+		bp [8] | bp [9] << 8 | bp [10] << 16 | (unsigned) bp [11] << 24);
+
+	if ( (bp [6] | bp [7] << 8) == 2 )
+		return	1;
+
+	for (i = 256; i < bsize; i += rsize)
+		{
+		if ( i + 16 > bsize )
+			return	0;
+
+		rsize = bp [i] | bp [i + 1] << 8;
+		rtype = bp [i + 2] | bp [i + 3] << 8;
+		i += 16;
+
+		if ( i + rsize > bsize )
+			return	0;
+
+		if ( rtype == XP_K_SUMMARY || rtype == XP_K_FILE || rtype == XP_K_VBN )
+			xp_addrec (jp, rtype, n * blocksize + i, rsize,
+				bp [i - 8] | bp [i - 7] << 8 | bp [i - 6] << 16 | (unsigned) bp [i - 5] << 24);
+		}
+
+	return	1;
+}
+
+/*
+ *  pwrite () all LEN bytes at P to offset OUT of FD.
+ */
+static int	xp_pwrite	(
+		int	fd,
+		char *	p,
+		int	len,
+		off_t	out
+			)
+{
+int	n;
+
+	for ( ; len > 0; len -= n, p += n, out += n)
+		if ( 0 > (n = pwrite (fd, p, len, out)) )
+			{
+			if ( errno == EINTR )
+				{
+				n = 0;
+				continue;
+				}
+
+			return	-1;
+			}
+
+	return	0;
+}
+
+/*
+ *  Write one tagged VBN record.  With sparse output, VBNs of zeros are
+ *  left as holes; but the last byte of the file is always written, so
+ *  that it has its full size.
+ */
+static int	xp_write	(
+		XP_JOB *	jp,
+		XP_REC *	rp,
+		char *		tmp
+			)
+{
+char	*p = jp->win + rp->off;
+off_t	out = (off_t) (rp->vbn - 1) * 512;
+int	len = rp->len, i, j;
+
+	if ( !rp->vbn || out >= rp->size )
+		return	0;
+
+	if ( len > rp->size - out )
+		len = rp->size - out;
+
+	if ( rp->cr )
+		{
+		for (i = 0; i < len; i++)
+			tmp [i] = p [i] == '\r' ? '\n' : p [i];
+
+		p = tmp;
+		}
+
+	if ( !flag_sparse )
+		return	xp_pwrite (rp->fd, p, len, out);
+
+	for (i = 0; i < len; i = j)
+		{
+		for (j = i; j < len && !is_zero ((unsigned char *) p + j, MIN (512, len - j)); j += 512)
+			;
+
+		if ( j > len )
+			j = len;
+
+		if ( j > i && xp_pwrite (rp->fd, p + i, j - i, out + i) )
+			return	-1;
+
+		/* Then the zeros.  */
+		for (i = j; j < len && is_zero ((unsigned char *) p + j, MIN (512, len - j)); j += 512)
+			;
+
+		if ( j >= len )
+			j = len;
+
+		if ( j > i && out + j == rp->size && xp_pwrite (rp->fd, p + j - 1, 1, out + j - 1) )
+			return	-1;
+		}
+
+	return	0;
+}
+
+static void *	xp_worker	(
+		void *	arg
+			)
+{
+XP_JOB	*jp = arg;
+char	*p = jp->win + (size_t) jp->first * blocksize, *tmp;
+size_t	want = (size_t) jp->nblk * blocksize, got;
+ssize_t	n;
+int	i;
+
+	if ( xp_pass == 1 )
+		{
+		jp->nrec = jp->err = 0;
+		jp->bad = -1;
+
+		if ( input.map )
+			{
+			got = input.mapsz - MIN (input.mapsz, jp->winoff + (size_t) jp->first * blocksize);
+			want = MIN (want, got);
+			}
+		else	for (got = 0; got < want; got += n)
+				if ( 0 >= (n = pread (jp->fd, p + got, want - got, jp->winoff + jp->first * blocksize + got)) )
+					{
+					if ( n < 0 && errno == EINTR )
+						{
+						n = 0;
+						continue;
+						}
+
+					if ( n < 0 )
+						jp->err = errno;
+
+					want = got;
+					break;
+					}
+
+		jp->got = want / blocksize;
+
+		for (i = 0; i < jp->got; i++)
+			if ( !xp_scan (jp, jp->first + i) )
+				{
+				jp->bad = jp->first + i;
+				break;
+				}
+
+		return	NULL;
+		}
+
+	if ( !(tmp = malloc (blocksize)) )
+		{
+		jp->err = ENOMEM;
+		return	NULL;
+		}
+
+	for (i = 0; i < jp->nrec; i++)
+		if ( jp->rec [i].fd >= 0 && xp_write (jp, &jp->rec [i], tmp) )
+			{
+			jp->err = errno;
+			break;
+			}
+
+	free (tmp);
+
+	return	NULL;
+}
+
+/*
+ *  Run pass PASS of the window on NJOBS threads.
+ */
+static void	xp_run	(
+		XP_JOB *	jobs,
+		int		njobs,
+		int		pass
+			)
+{
+int	i;
+
+	xp_pass = pass;
+
+	for (i = 1; i < njobs; i++)
+		if ( (errno = pthread_create (&jobs [i].thread, NULL, xp_worker, &jobs [i])) )
+			{
+			perror ("extraction thread");
+			exit (1);
+			}
+
+	xp_worker (&jobs [0]);
+
+	for (i = 1; i < njobs; i++)
+		pthread_join (jobs [i].thread, NULL);
+}
+
+/*
+ *  Extract the saveset on disk open in INPUT with NJOBS threads, up to
+ *  its end or the first block we cannot decode.  The input is left
+ *  positioned there for vmsbackup () to go on from.  Returns -1 if it
+ *  cannot be.
+ */
+int	par_extract	(
+		int	njobs
+			)
+{
+XP_JOB	*jobs;
+XP_REC	*rp;
+char	*win = NULL;
+int	i, j, fd, cr = 0, size = 0, bad = -1, curfd = -1, ncl = 0, acl = 0, *cl = NULL;
+struct timespec	*clt = NULL;
+int	skip = 0, drop = 0;
+off_t	winoff, k, end = 0;
+size_t	winsz = (size_t) njobs * XP_BLOCKS * blocksize;
+
+	if ( !(jobs = calloc (njobs, sizeof (XP_JOB)))
+		|| (!input.map && !(win = malloc (winsz))) )
+		{
+		fprintf (stderr, "out of memory\n");
+		exit (1);
+		}
+
+	for (winoff = 0; bad < 0; winoff += winsz)
+		{
+		if ( input.map )
+			win = (char *) input.map + winoff;
+
+		for (i = 0; i < njobs; i++)
+			{
+			jobs [i].fd = input.fd;
+			jobs [i].win = win;
+			jobs [i].winoff = winoff;
+			jobs [i].first = i * XP_BLOCKS;
+			jobs [i].nblk = XP_BLOCKS;
+
+			}
+
+		xp_run (jobs, njobs, 1);
+
+		/* Go through the records in saveset order, up to the first
+		   block we could not read or decode, or one to be rebuilt
+		   from its redundancy group.  */
+		bad = -1;
+
+		for (i = 0; i < njobs && bad < 0; i++)
+			{
+			if ( jobs [i].err )
+				{
+				errno = jobs [i].err;
+				perror ("error reading saveset");
+				exit (1);
+				}
+
+			for (j = 0; j < jobs [i].nrec && bad < 0; j++)
+				{
+				rp = &jobs [i].rec [j];
+
+				if ( skip && rp->type > 0 )
+					continue;
+
+				switch (rp->type)
+					{
+					case XP_K_BADBLK:
+						/* Leave it to process_block ().  */
+						if ( grpsize )
+							bad = rp->off / blocksize;
+						else	drop = blk_verify ((unsigned char *) win + rp->off, rp->len, winoff + rp->off);
+						break;
+
+					case XP_K_BLOCK:
+						skip = drop || !group_take ((unsigned char *) win + rp->off, winoff + rp->off);
+						drop = 0;
+						break;
+
+					case XP_K_SUMMARY:
+						process_summary ((unsigned char *) win + rp->off, rp->len);
+						break;
+
+					case XP_K_FILE:
+						if ( curfd >= 0 )
+							{
+							if ( ncl == acl && (!(cl = realloc (cl, (acl = acl ? 2 * acl : 64) * sizeof (int)))
+								|| !(clt = realloc (clt, 2 * acl * sizeof (struct timespec)))) )
+								{
+								fprintf (stderr, "out of memory\n");
+								exit (1);
+								}
+
+							/* Its times, for when it is all written.  */
+							out_times (clt + 2 * ncl);
+							cl [ncl++] = curfd;
+							}
+
+						process_file ((unsigned char *) win + rp->off, rp->len);
+
+						curfd = 0 <= (fd = vbn_direct (&size, &cr)) ? dup (fd) : -1;
+						end = 0;
+						break;
+
+					case XP_K_VBN:
+						if ( curfd < 0 )
+							process_vbn ((unsigned char *) win + rp->off, rp->len);
+						else	{
+							rp->fd = curfd;
+							rp->cr = cr;
+							rp->size = size;
+
+							if ( rp->vbn && (k = (off_t) (rp->vbn - 1) * 512 + rp->len) > end )
+								end = MIN (k, size);
+							}
+						break;
+					}
+				}
+
+			if ( bad < 0 && (bad = jobs [i].bad) < 0 && jobs [i].got < jobs [i].nblk )
+				bad = jobs [i].first + jobs [i].got;
+			}
+
+		xp_run (jobs, njobs, 2);
+
+		for (i = 0; i < njobs; i++)
+			if ( jobs [i].err )
+				{
+				errno = jobs [i].err;
+				perror ("error writing file");
+				exit (1);
+				}
+
+		for ( ; ncl > 0; ncl--)
+			{
+#ifndef	NO_UTIMENS
+			futimens (cl [ncl - 1], clt + 2 * (ncl - 1));
+#endif
+			close (cl [ncl - 1]);
+			}
+		}
+
+	winoff -= winsz;
+
+	if ( curfd >= 0 )
+		close (curfd);
+
+	for (i = 0; i < njobs; i++)
+		free (jobs [i].rec);
+
+	free (jobs);
+	free (cl);
+	free (clt);
+
+	if ( !input.map )
+		free (win);
+
+	/* Hand the rest over to the usual loop, which will find the end
+	   of the saveset there or deal with the block we could not.  */
+	if ( curfd >= 0 )
+		vbn_resume (end);
+
+	return	inp_seek (&input, winoff + (off_t) bad * blocksize);
+}
+
+#else
+
+int	par_extract	(
+		int	njobs
+			)
+{
+	return	0;
+}
+
+#endif
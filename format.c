@@ -0,0 +1,392 @@
+/*
+ *
+ *  Title:
+ *	Listings for programs
+ *
+ *  Description:
+ *	With --format=jsonl or --format=csv, -t lists each file as one
+ *	record (a JSON object on a line, or a CSV row after a row of
+ *	column names) with everything its file header says, instead of the
+ *	BACKUP/LIST style text of process_file ().  Nothing else goes to
+ *	the standard output.
+ *
+ *	Savesets with millions of files are listed in about the time it
+ *	takes to read them, so the records are put together by hand in a
+ *	buffer written out 64 KB at a time: numbers are converted and
+ *	strings escaped byte by byte, with no printf () in the loop.
+ *
+ *	The names of RMS record formats, organizations and attributes are
+ *	here too, for pax.c.
+ *
+ */
+
+#ifdef HAVE_UNIXIO_H
+#include	<unixio.h>
+#else
+#include	<unistd.h>
+#endif
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+
+#include	<sys/types.h>
+
+#include	"fabdef.h"
+#include	"vmsbackup.h"
+#include	"libvmsbackup.h"
+
+#define	FMT_BUFSZ	(64 * 1024)
+
+static char	fmt_buf [FMT_BUFSZ];
+static size_t	fmt_pos;
+static int	fmt_started;
+
+/* The columns, in order; the keys of the JSON objects.  */
+static const char	*fmt_cols [] = {
+	"saveset", "name", "blocks", "size", "fid_num", "fid_seq", "fid_rvn",
+	"uic_group", "uic_member", "protection", "revision", "org", "rfm",
+	"rat", "mrs", "fsz", "ebk", "ffb", "alq", "deq",
+	"created", "revised", "expires", "backup"
+	};
+
+#define	FMT_NCOLS	(sizeof (fmt_cols) / sizeof (fmt_cols [0]))
+
+/*
+ *  The name of the record format in RECFMT, or NULL if it has none.
+ */
+const char *	fmt_rfm	(
+		int	recfmt
+			)
+{
+static const char	*names [] = { "UDF", "FIX", "VAR", "VFC", "STM", "STMLF", "STMCR" };
+
+	recfmt &= 0x0f;
+
+	return	recfmt < (int) (sizeof (names) / sizeof (names [0])) ? names [recfmt] : NULL;
+}
+
+/*
+ *  The name of the file organization in RECFMT.
+ */
+const char *	fmt_org	(
+		int	recfmt
+			)
+{
+static const char	*names [] = { "SEQ", "REL", "IDX", "HSH" };
+
+	return	names [(recfmt >> 4) & 3];
+}
+
+/*
+ *  The record attributes RECATT as a list ("FTN,CR"), into BUF (at
+ *  least 16 bytes).
+ */
+char *	fmt_rat	(
+		char *	buf,
+		int	recatt
+			)
+{
+char	*p = buf;
+
+	*p = '\0';
+
+	if ( recatt & FAB$M_FTN )
+		p = strcpy (p, ",FTN") + 4;
+
+	if ( recatt & FAB$M_CR )
+		p = strcpy (p, ",CR") + 3;
+
+	if ( recatt & FAB$M_PRN )
+		p = strcpy (p, ",PRN") + 4;
+
+	if ( recatt & FAB$M_BLK )
+		p = strcpy (p, ",BLK") + 4;
+
+	return	buf + (*buf == ',');
+}
+
+/*
+ *  Write out what has been put in the buffer.
+ */
+void	fmt_flush	(void)
+{
+	if ( fmt_pos && fwrite (fmt_buf, 1, fmt_pos, stdout) != fmt_pos )
+		{
+		perror ("writing the listing");
+		exit (1);
+		}
+
+	fmt_pos = 0;
+}
+
+static void	fmt_put	(
+		const char *	p,
+		size_t		n
+			)
+{
+	if ( fmt_pos + n > FMT_BUFSZ )
+		fmt_flush ();
+
+	memcpy (fmt_buf + fmt_pos, p, n);
+	fmt_pos += n;
+}
+
+static void	fmt_putc	(
+		int	c
+			)
+{
+	if ( fmt_pos == FMT_BUFSZ )
+		fmt_flush ();
+
+	fmt_buf [fmt_pos++] = c;
+}
+
+/*
+ *  The number N in decimal.
+ */
+static void	fmt_num	(
+		unsigned long	n
+			)
+{
+char	tmp [24], *p = tmp + sizeof (tmp);
+
+	do	*--p = '0' + n % 10;
+	while ( n /= 10 );
+
+	fmt_put (p, tmp + sizeof (tmp) - p);
+}
+
+/*
+ *  The string S as a JSON or CSV string.  CSV fields are quoted only
+ *  when they have to be.
+ */
+static void	fmt_str	(
+		const char *	s
+			)
+{
+static const char	hex [] = "0123456789abcdef";
+const unsigned char	*p;
+
+	if ( listfmt == LIST_K_CSV )
+		{
+		if ( !s [strcspn (s, ",\"\r\n")] )
+			{
+			fmt_put (s, strlen (s));
+			return;
+			}
+
+		fmt_putc ('"');
+
+		for (p = (const unsigned char *) s; *p; p++)
+			{
+			if ( *p == '"' )
+				fmt_putc ('"');
+
+			fmt_putc (*p);
+			}
+
+		fmt_putc ('"');
+		return;
+		}
+
+	fmt_putc ('"');
+
+	for (p = (const unsigned char *) s; *p; p++)
+		if ( *p == '"' || *p == '\\' )
+			{
+			fmt_putc ('\\');
+			fmt_putc (*p);
+			}
+		else if ( *p < 0x20 || *p >= 0x7f )
+			{
+			/* VMS names are ASCII; anything else is shown as
+			   the byte it is, which keeps the line valid.  */
+			fmt_put ("\\u00", 4);
+			fmt_putc (hex [*p >> 4]);
+			fmt_putc (hex [*p & 15]);
+			}
+		else	fmt_putc (*p);
+
+	fmt_putc ('"');
+}
+
+/*
+ *  Two digits of N, zero-filled, into P.
+ */
+static char *	fmt_2	(
+		char *		p,
+		unsigned	n
+			)
+{
+	*p++ = '0' + n / 10 % 10;
+	*p++ = '0' + n % 10;
+
+	return	p;
+}
+
+/*
+ *  The VMS date Q, in the local time of the system it was written on, as
+ *  "YYYY-MM-DDTHH:MM:SS.CC" (to hundredths, as VMS shows them) into BUF.
+ *  Returns 0 if it is not set.
+ */
+static int	fmt_date	(
+		char *			buf,
+		const unsigned char *	q
+			)
+{
+static const unsigned char	zero [8];
+VT_TIME	t;
+char	*p = buf;
+
+	if ( !memcmp (q, zero, 8) || !vt_split (q, &t) )
+		return	0;
+
+	p = fmt_2 (fmt_2 (p, t.year / 100), t.year);
+	*p++ = '-';
+	p = fmt_2 (p, t.month);
+	*p++ = '-';
+	p = fmt_2 (p, t.day);
+	*p++ = 'T';
+	p = fmt_2 (p, t.hour);
+	*p++ = ':';
+	p = fmt_2 (p, t.minute);
+	*p++ = ':';
+	p = fmt_2 (p, t.second);
+	*p++ = '.';
+	p = fmt_2 (p, t.hundredth);
+	*p = '\0';
+
+	return	1;
+}
+
+/*
+ *  Start column N of a record.
+ */
+static void	fmt_col	(
+		int	n
+			)
+{
+	if ( listfmt == LIST_K_CSV )
+		{
+		if ( n )
+			fmt_putc (',');
+
+		return;
+		}
+
+	fmt_put (n ? ",\"" : "{\"", 2);
+	fmt_put (fmt_cols [n], strlen (fmt_cols [n]));
+	fmt_put ("\":", 2);
+}
+
+/*
+ *  The file FP, with BLOCKS blocks as the listing has it, as a record.
+ */
+void	fmt_file	(
+		const VB_FILE *	fp,
+		unsigned	blocks
+			)
+{
+const unsigned char	*date;
+char	buf [32];
+unsigned	n;
+int	i, c = 0;
+
+	if ( !fmt_started && listfmt == LIST_K_CSV && ms_index () <= 0 )
+		for (n = 0; n < FMT_NCOLS; n++)
+			{
+			fmt_put (fmt_cols [n], strlen (fmt_cols [n]));
+			fmt_putc (n + 1 < FMT_NCOLS ? ',' : '\n');
+			}
+
+	fmt_started = 1;
+
+	fmt_col (c++);
+	fmt_str (tapefile);
+	fmt_col (c++);
+	fmt_str (fp->name);
+	fmt_col (c++);
+	fmt_num (blocks);
+	fmt_col (c++);
+	fmt_num (fp->size > 0 ? fp->size : 0);
+
+	for (i = 0; i < 3; i++)
+		{
+		fmt_col (c++);
+		fmt_num (fp->fid [i]);
+		}
+
+	fmt_col (c++);
+	fmt_num (fp->uic_group);
+	fmt_col (c++);
+	fmt_num (fp->uic_member);
+
+	/* As BACKUP/LIST shows it, a bit set in each field denying.  */
+	for (i = 0, n = 0; i < 4; i++)
+		{
+		buf [n++] = "SOGW" [i];
+		buf [n++] = ':';
+
+		if ( !(fp->protection >> (i * 4) & 1) )
+			buf [n++] = 'R';
+
+		if ( !(fp->protection >> (i * 4) & 2) )
+			buf [n++] = 'W';
+
+		if ( !(fp->protection >> (i * 4) & 4) )
+			buf [n++] = 'E';
+
+		if ( !(fp->protection >> (i * 4) & 8) )
+			buf [n++] = 'D';
+
+		if ( i < 3 )
+			buf [n++] = ',';
+		}
+
+	buf [n] = '\0';
+	fmt_col (c++);
+	fmt_str (buf);
+
+	fmt_col (c++);
+	fmt_num (fp->revision);
+	fmt_col (c++);
+	fmt_str (fmt_org (fp->recfmt));
+	fmt_col (c++);
+
+	if ( fmt_rfm (fp->recfmt) )
+		fmt_str (fmt_rfm (fp->recfmt));
+	else	fmt_num (fp->recfmt & 0x0f);
+
+	fmt_col (c++);
+	fmt_str (fmt_rat (buf, fp->recatt));
+	fmt_col (c++);
+	fmt_num (fp->recsize);
+	fmt_col (c++);
+	fmt_num ((fp->recfmt & 0x0f) == FAB$C_VFC ? fp->vfcsize : 0);
+	fmt_col (c++);
+	fmt_num (fp->nblk);
+	fmt_col (c++);
+	fmt_num (fp->lnch);
+	fmt_col (c++);
+	fmt_num (fp->ablk);
+	fmt_col (c++);
+	fmt_num (fp->extension);
+
+	/* Dates not set are null, or empty.  */
+	for (i = 0; i < 4; i++)
+		{
+		date = i == 0 ? fp->created : i == 1 ? fp->revised : i == 2 ? fp->expires : fp->backup;
+		fmt_col (c++);
+
+		if ( fmt_date (buf, date) )
+			fmt_str (buf);
+		else if ( listfmt == LIST_K_JSONL )
+			fmt_put ("null", 4);
+		}
+
+	if ( listfmt == LIST_K_JSONL )
+		fmt_putc ('}');
+
+	fmt_putc ('\n');
+}
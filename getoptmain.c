@@ -4,6 +4,7 @@ char *version = "VMSBACKUP4.3";
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "vmsbackup.h"
 #include "getopt.h"
 
@@ -13,20 +14,42 @@ char *version = "VMSBACKUP4.3";
 
 void	usage	(char *progname)
 {
-	fprintf (stderr, "Usage:  %s -{tx}[cdevwF][-b blocksize][-s setnumber][-f tapefile]\n",
+	fprintf (stderr, "Usage:  %s -{tx}[cdemvwFIP][-b blocksize][-j jobs][-W writers][-r depth][-T megabytes][-C catalog][-s setnumber][-f tapefile]\n",
 		 progname);
 #ifdef HAVE_GETOPTLONG
 	fprintf(stderr, "\nWith long versions of the above:\n"
 	"\tb\tblocksize\tUse specified blocksize\n"
 	"\tc\tcomplete\t\tRetain complete filename\n"
+	"\tC\tcatalog\t\tRecord/use tape positions in this file\n"
 	"\td\tdirectory\tCreate subdirectories\n"
 	"\te\textension\tExtract all files\n"
-	"\tf\tfile\t\tRead from file\n"
+	"\tf\tfile\t\tRead from file (again for more savesets)\n"
+	"\t\tparallel\tRead this many of the savesets at once\n"
+	"\tj\tjobs\t\tExtract with this many threads\n"
+	"\tI\tindex\t\tBuild an index of a saveset on disk\n"
+	"\tm\tmmap\t\tMap a saveset on disk into memory\n"
+	"\tP\tpreallocate\tAllocate extracted files in one go\n"
+	"\t\tmap-output\tDecode into a mapping of the extracted file\n"
+	"\t\tno-sparse\tWrite out VBNs of zeros rather than leave holes\n"
+	"\tr\treadahead\tRead ahead this many blocks in a thread\n"
 	"\ts\tsaveset\t\tRead saveset number\n"
 	"\tt\tlist\t\tList files in saveset\n"
 	"\tv\tverbose\t\tList files as they are processed\n"
+	"\tW\twriters\t\tWrite and close extracted files in this many threads\n"
+	"\t\twriter-memory\tMegabytes of data that may wait for the writers\n"
 	"\tw\tconfirm\t\tConfirm files before restoring\n"
 	"\tx\textract\t\tExtract files\n"
+	"\tT\ttapebuffer\tStream the tape into a buffer of this many MB\n"
+	"\t\tlowwater\tRestart the tape at this percentage of the buffer\n"
+	"\t\thighwater\tStop the tape at this percentage of the buffer\n"
+	"\t\tcrc\t\tverify, warn (default) or skip block CRC checks\n"
+	"\t\tcarve\t\tFind the blocks of a damaged saveset, write this block map\n"
+	"\t\tblockmap\tRead the blocks in this block map only\n"
+	"\t\tinclude-from\tSelect the files named in this file\n"
+	"\t\texclude-from\tSkip the files named in this file\n"
+	"\t\tvms-match\tNames are VMS file specifications\n"
+	"\t\tpax\t\tWrite the files as a pax archive to stdout\n"
+	"\t\tformat\t\tList as text (default), jsonl or csv\n"
 	"\tF\tfull\t\tFull detail in listing\n"
 	"\tV\tversion\t\tShow program version number\n"
 	"\tB\tbinary\t\tExtract as binary files\n"
@@ -38,18 +61,58 @@ extern int optind;
 extern char *optarg;
 
 #ifdef HAVE_GETOPTLONG
+/* Codes for options which only have a long form.  */
+enum	{
+	OPT_LOWWATER = 256,
+	OPT_HIGHWATER,
+	OPT_CRC,
+	OPT_CARVE,
+	OPT_BLOCKMAP,
+	OPT_MAPOUT,
+	OPT_NOSPARSE,
+	OPT_WRITERMEM,
+	OPT_INCLUDEFROM,
+	OPT_EXCLUDEFROM,
+	OPT_VMSMATCH,
+	OPT_PARALLEL,
+	OPT_PAX,
+	OPT_FORMAT
+	};
+
 static const struct option OptionListLong[] =
 {
 	{"blocksize", 1, 0, 'b'},
 	{"complete", 0, 0, 'c'},
+	{"catalog", 1, 0, 'C'},
 	{"directory", 0, 0, 'd'},
 	{"extension", 0, 0, 'e'},
 	{"file", 1, 0, 'f'},
+	{"index", 0, 0, 'I'},
+	{"jobs", 1, 0, 'j'},
+	{"mmap", 0, 0, 'm'},
+	{"preallocate", 0, 0, 'P'},
+	{"map-output", 0, 0, OPT_MAPOUT},
+	{"no-sparse", 0, 0, OPT_NOSPARSE},
+	{"readahead", 1, 0, 'r'},
 	{"saveset", 1, 0, 's'},
 	{"list", 0, 0, 't'},
 	{"verbose", 0, 0, 'v'},
+	{"writers", 1, 0, 'W'},
+	{"writer-memory", 1, 0, OPT_WRITERMEM},
 	{"confirm", 0, 0, 'w'},
 	{"extract", 0, 0, 'x'},
+	{"tapebuffer", 1, 0, 'T'},
+	{"lowwater", 1, 0, OPT_LOWWATER},
+	{"highwater", 1, 0, OPT_HIGHWATER},
+	{"crc", 1, 0, OPT_CRC},
+	{"carve", 1, 0, OPT_CARVE},
+	{"blockmap", 1, 0, OPT_BLOCKMAP},
+	{"include-from", 1, 0, OPT_INCLUDEFROM},
+	{"exclude-from", 1, 0, OPT_EXCLUDEFROM},
+	{"vms-match", 0, 0, OPT_VMSMATCH},
+	{"parallel", 1, 0, OPT_PARALLEL},
+	{"pax", 0, 0, OPT_PAX},
+	{"format", 1, 0, OPT_FORMAT},
 	{"full", 0, 0, 'F'},
 	{"version", 0, 0, 'V'},
 	{"binary", 0, 0, 'B'},
@@ -79,13 +142,20 @@ int OptionIndex;
 	cflag=dflag=eflag=sflag=tflag=vflag=wflag=xflag=debugflag=0;
 	flag_binary = 0;
 	flag_full = 0;
+	flag_mmap = 0;
+	flag_index = 0;
+	jobs = 0;
+	parallel = 0;
+	readahead = 0;
+	tapebuffer = 0;
 	tapefile = NULL;
+	catalog = NULL;
 
 #ifdef HAVE_GETOPTLONG
-	while((c=getopt_long(argc,argv,"b:cdef:s:tvwxFVBD",
+	while((c=getopt_long(argc,argv,"b:cC:def:Ij:mPr:s:tvwW:xFT:VBD",
 		OptionListLong, &OptionIndex)) != EOF)
 #else
-	while((c=getopt(argc,argv,"b:cdef:s:tvwxFVBD")) != EOF)
+	while((c=getopt(argc,argv,"b:cC:def:Ij:mPr:s:tvwW:xFT:VBD")) != EOF)
 #endif
 		switch(c){
 		case 'b':
@@ -94,6 +164,9 @@ int OptionIndex;
 		case 'c':
 			cflag++;
 			break;
+		case 'C':
+			catalog = optarg;
+			break;
 		case 'd':
 			dflag++;
 			break;
@@ -101,7 +174,25 @@ int OptionIndex;
 			eflag++;
 			break;
 		case 'f':
-			tapefile = optarg;
+			ms_add (optarg);
+			break;
+		case 'I':
+			flag_index = 1;
+			break;
+		case 'j':
+			sscanf (optarg, "%d", &jobs);
+			break;
+		case 'm':
+			flag_mmap = 1;
+			break;
+		case 'P':
+			flag_prealloc = 1;
+			break;
+		case 'W':
+			sscanf (optarg, "%d", &writers);
+			break;
+		case 'r':
+			sscanf (optarg, "%d", &readahead);
 			break;
 		case 's':
 			sflag++;
@@ -131,6 +222,72 @@ int OptionIndex;
 			   or whatever it is called.  */
 			flag_full = 1;
 			break;
+		case 'T':
+			sscanf (optarg, "%d", &tapebuffer);
+			break;
+#ifdef HAVE_GETOPTLONG
+		case OPT_LOWWATER:
+			sscanf (optarg, "%d", &lowwater);
+			break;
+		case OPT_HIGHWATER:
+			sscanf (optarg, "%d", &highwater);
+			break;
+		case OPT_CRC:
+			if ( !strcmp (optarg, "verify") )
+				crcmode = CRC_K_VERIFY;
+			else if ( !strcmp (optarg, "warn") )
+				crcmode = CRC_K_WARN;
+			else if ( !strcmp (optarg, "skip") )
+				crcmode = CRC_K_SKIP;
+			else	{
+				fprintf (stderr, "%s: --crc must be verify, warn or skip\n", progname);
+				exit (1);
+				}
+			break;
+		case OPT_MAPOUT:
+			flag_mapout = 1;
+			break;
+		case OPT_NOSPARSE:
+			flag_sparse = 0;
+			break;
+		case OPT_WRITERMEM:
+			sscanf (optarg, "%d", &writer_mem);
+			break;
+		case OPT_CARVE:
+			flag_carve = 1;
+			/* FALLTHROUGH */
+		case OPT_BLOCKMAP:
+			blockmap = optarg;
+			break;
+		case OPT_INCLUDEFROM:
+			includefrom = optarg;
+			break;
+		case OPT_EXCLUDEFROM:
+			excludefrom = optarg;
+			break;
+		case OPT_VMSMATCH:
+			flag_vmsmatch = 1;
+			break;
+		case OPT_PARALLEL:
+			sscanf (optarg, "%d", &parallel);
+			break;
+		case OPT_PAX:
+			flag_pax = 1;
+			xflag++;
+			break;
+		case OPT_FORMAT:
+			if ( !strcmp (optarg, "text") )
+				listfmt = LIST_K_TEXT;
+			else if ( !strcmp (optarg, "jsonl") )
+				listfmt = LIST_K_JSONL;
+			else if ( !strcmp (optarg, "csv") )
+				listfmt = LIST_K_CSV;
+			else	{
+				fprintf (stderr, "%s: --format must be text, jsonl or csv\n", progname);
+				exit (1);
+				}
+			break;
+#endif
 		case 'V':
 			printf ("VMSBACKUP version %s\n", version);
 			exit (EXIT_FAILURE);
@@ -150,11 +307,24 @@ int OptionIndex;
 			break;
 		};
 	goptind = optind;
+	if (lowwater < 0 || highwater > 100 || lowwater >= highwater) {
+		fprintf (stderr, "%s: need 0 <= lowwater < highwater <= 100\n",
+			 progname);
+		exit(1);
+	}
 	if(!tflag && !xflag) {
 		usage(progname);
 		exit(1);
 	}
+	if (flag_pax && (tflag || wflag)) {
+		fprintf (stderr, "%s: --pax cannot be used with -t or -w\n",
+			 progname);
+		exit(1);
+	}
+
 
+	if ( ms_count () > 1 )
+		ms_run ();
 
 	vmsbackup ();
 }
@@ -191,8 +361,9 @@ int	time_vms_to_asc (
 		void	*srctime
 			)
 {
-	*asclength = '\0';
-	return 1;
+	/* See vmstime.c.  */
+	*asclength = vt_asc (srctime, ascbuffer);
+	return *asclength ? 1 : 0;
 }
 #endif
 
@@ -0,0 +1,492 @@
+/*
+ *
+ *  Title:
+ *	Saveset index
+ *
+ *  Description:
+ *	Random access to a saveset on disk through a sidecar index, kept
+ *	next to it as <saveset>.bckidx.  The index is built (with -I) while
+ *	the saveset is read through in the usual way: for every file it
+ *	keeps a copy of the file record and, for every VBN record of its
+ *	data, where in the saveset the record is, how long it is and the
+ *	virtual block number it starts at.  A copy of the summary record
+ *	goes in too.
+ *
+ *	Later listings then need nothing but the index, and extractions
+ *	pread () just the blocks holding the data of the files wanted.
+ *
+ *	The index is one block of memory, written and mapped as is:
+ *
+ *		IDX_HDR		header, with the sizes and offsets below
+ *		IDX_FILE [n]	one per file record, in saveset order
+ *		IDX_RANGE [m]	one per VBN record, grouped by file
+ *		data		the summary and file records
+ *
+ *	in host byte order and with natural alignment.  It is only trusted
+ *	if its version and byte order are ours and the saveset still has
+ *	the size, modification time and summary record it was built from.
+ *
+ */
+
+#ifdef HAVE_UNIXIO_H
+#include	<unixio.h>
+#else
+#include	<unistd.h>
+#include	<fcntl.h>
+#endif
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+
+#include	<sys/types.h>
+#include	<sys/stat.h>
+#ifndef	NO_MMAP
+#include	<sys/mman.h>
+#endif
+
+#include	"vmsbackup.h"
+
+#define	IDX_MAGIC	"BCKIDX\r\n"
+#define	IDX_VERSION	1
+#define	IDX_ORDER	0x01020304
+#define	IDX_SUFFIX	".bckidx"
+
+typedef struct __idx_hdr {
+	char		magic [8];
+	unsigned	version,
+			order;		/* IDX_ORDER as we wrote it */
+
+	unsigned long long	size;	/* saveset size ... */
+	long long	mtime;		/* ... and modification time */
+	unsigned long long	sumoff;	/* offset of the summary record data in the saveset */
+
+	unsigned	sumlen,
+			sumsum,		/* idx_sum () of the summary record */
+			blocksize,
+			nfiles,
+			nranges,
+			datalen;
+
+	unsigned long long	filesoff,	/* offsets in the index */
+			rangesoff,
+			dataoff;
+} IDX_HDR;
+
+typedef struct __idx_file {
+	unsigned	recoff,		/* file record, in the data area */
+			reclen,
+			first,		/* its VBN records in the range table */
+			count;
+} IDX_FILE;
+
+typedef struct __idx_range {
+	unsigned long long	blkoff;	/* saveset offset of the block ... */
+	unsigned	recoff,		/* ... and of the record data within it */
+			len,
+			vbn,		/* brh->l_address */
+			spare;
+} IDX_RANGE;
+
+/* The index we are reading from.  */
+static unsigned char	*idx_map;
+static size_t	idx_mapsz;
+static int	idx_mapped;
+static IDX_HDR	*hdr;
+static IDX_FILE	*ifiles;
+static IDX_RANGE	*iranges;
+static unsigned char	*idata;
+
+/* The index we are building.  */
+static int	building;
+static IDX_HDR	nhdr;
+static IDX_FILE	*nfiles_idx;
+static int	afiles_idx;
+static IDX_RANGE	*nranges_idx;
+static int	aranges_idx;
+static unsigned char	*ndata;
+static unsigned	adata;
+
+static void *	idx_grow	(
+		void *	p,
+		int *	allocp,
+		int	n,
+		size_t	size
+			)
+{
+	if ( n < *allocp )
+		return	p;
+
+	*allocp = *allocp ? 2 * *allocp : 256;
+
+	if ( !(p = realloc (p, *allocp * size)) )
+		{
+		fprintf (stderr, "out of memory\n");
+		exit (1);
+		}
+
+	return	p;
+}
+
+/*
+ *  Checksum of LEN bytes at P (FNV-1a); enough to notice that a saveset
+ *  has been rewritten under the same name.
+ */
+static unsigned	idx_sum	(
+		unsigned char *	p,
+		size_t		len
+			)
+{
+unsigned	h = 2166136261u;
+
+	while ( len-- )
+		h = (h ^ *p++) * 16777619u;
+
+	return	h;
+}
+
+static char *	idx_path	(
+		char *	saveset
+			)
+{
+char	*path;
+
+	if ( !(path = malloc (strlen (saveset) + sizeof (IDX_SUFFIX))) )
+		{
+		fprintf (stderr, "out of memory\n");
+		exit (1);
+		}
+
+	return	strcat (strcpy (path, saveset), IDX_SUFFIX);
+}
+
+static void	idx_unmap	(void)
+{
+#ifndef	NO_MMAP
+	if ( idx_mapped )
+		munmap (idx_map, idx_mapsz);
+	else
+#endif
+	free (idx_map);
+
+	idx_map = NULL;
+	hdr = NULL;
+}
+
+/*
+ *  Look for the index of SAVESET, whose descriptor is FD, and check it
+ *  still describes it.  Returns 1 if it can be used.
+ */
+int	idx_open	(
+		char *	saveset,
+		int	fd
+			)
+{
+char	*path = idx_path (saveset);
+struct	stat	st, sst;
+unsigned char	*sum = NULL;
+unsigned	i;
+int	ifd, ok = 0;
+size_t	need;
+
+	if ( 0 > (ifd = open (path, O_RDONLY)) )
+		{
+		free (path);
+		return	0;
+		}
+
+	if ( fstat (ifd, &st) || fstat (fd, &sst) || st.st_size < sizeof (IDX_HDR) )
+		goto	done;
+
+	idx_mapsz = st.st_size;
+
+#ifndef	NO_MMAP
+	if ( MAP_FAILED != (idx_map = mmap (NULL, idx_mapsz, PROT_READ, MAP_SHARED, ifd, 0)) )
+		idx_mapped = 1;
+	else
+#endif
+	{
+	idx_map = NULL;
+
+	if ( !(idx_map = malloc (idx_mapsz)) || idx_mapsz != pread (ifd, idx_map, idx_mapsz, 0) )
+		goto	done;
+	}
+
+	hdr = (IDX_HDR *) idx_map;
+
+	if ( memcmp (hdr->magic, IDX_MAGIC, sizeof (hdr->magic))
+		|| hdr->version != IDX_VERSION || hdr->order != IDX_ORDER )
+		{
+		fprintf (stderr, "%s: not an index this program can use, ignored\n", path);
+		goto	done;
+		}
+
+	need = hdr->dataoff + hdr->datalen;
+
+	if ( hdr->filesoff + (size_t) hdr->nfiles * sizeof (IDX_FILE) > idx_mapsz
+		|| hdr->rangesoff + (size_t) hdr->nranges * sizeof (IDX_RANGE) > idx_mapsz
+		|| need > idx_mapsz || hdr->blocksize != blocksize )
+		goto	done;
+
+	/* Is it still the same saveset?  */
+	if ( hdr->size != (unsigned long long) sst.st_size || hdr->mtime != (long long) sst.st_mtime )
+		goto	done;
+
+	if ( !(sum = malloc (hdr->sumlen + 1))
+		|| hdr->sumlen != pread (fd, sum, hdr->sumlen, hdr->sumoff)
+		|| hdr->sumsum != idx_sum (sum, hdr->sumlen) )
+		goto	done;
+
+	ifiles	= (IDX_FILE *) (idx_map + hdr->filesoff);
+	iranges	= (IDX_RANGE *) (idx_map + hdr->rangesoff);
+	idata	= idx_map + hdr->dataoff;
+
+	for (i = 0; i < hdr->nfiles; i++)
+		if ( (unsigned long long) ifiles [i].recoff + ifiles [i].reclen > hdr->datalen
+			|| (unsigned long long) ifiles [i].first + ifiles [i].count > hdr->nranges )
+			goto	done;
+
+	ok	= 1;
+
+	if ( vflag )
+		printf ("Using index %s, %u files\n", path, hdr->nfiles);
+
+done:
+	if ( !ok && idx_map )
+		idx_unmap ();
+
+	free (sum);
+	free (path);
+	close (ifd);
+
+	return	ok;
+}
+
+/*
+ *  The summary record of the saveset in the index, for process_summary ().
+ */
+unsigned char *	idx_summary	(
+		size_t *	lenp
+			)
+{
+	*lenp = hdr->sumlen;
+
+	return	idata;
+}
+
+int	idx_nfiles	(void)
+{
+	return	hdr->nfiles;
+}
+
+/*
+ *  File record of the N'th file, for process_file (); the number of
+ *  its VBN records goes in *NRANGEP.
+ */
+unsigned char *	idx_file	(
+		int		n,
+		size_t *	lenp,
+		int *		nrangep
+			)
+{
+	*lenp = ifiles [n].reclen;
+	*nrangep = ifiles [n].count;
+
+	return	idata + ifiles [n].recoff;
+}
+
+/*
+ *  Where the K'th VBN record of the N'th file is: the offset of the
+ *  block it is in, and the offset and length of its data in that block.
+ */
+void	idx_range	(
+		int		n,
+		int		k,
+		off_t *		blkoffp,
+		int *		recoffp,
+		int *		lenp
+			)
+{
+IDX_RANGE	*rp = &iranges [ifiles [n].first + k];
+
+	*blkoffp = rp->blkoff;
+	*recoffp = rp->recoff;
+	*lenp = rp->len;
+}
+
+void	idx_close	(void)
+{
+	if ( hdr )
+		idx_unmap ();
+}
+
+/*
+ *  Start building an index while reading the saveset through.
+ */
+void	idx_begin	(void)
+{
+	memset (&nhdr, 0, sizeof (nhdr));
+	building = 1;
+}
+
+static unsigned	idx_adddata	(
+		unsigned char *	p,
+		size_t		len
+			)
+{
+unsigned	off = nhdr.datalen;
+
+	while ( nhdr.datalen + len > adata )
+		{
+		adata = adata ? 2 * adata : 65536;
+
+		if ( !(ndata = realloc (ndata, adata)) )
+			{
+			fprintf (stderr, "out of memory\n");
+			exit (1);
+			}
+		}
+
+	memcpy (ndata + off, p, len);
+	nhdr.datalen += len;
+
+	return	off;
+}
+
+/*
+ *  The summary record, LEN bytes at P, was found at offset OFF of the
+ *  saveset.  It has to come first, ahead of all the file records.
+ */
+void	idx_addsummary	(
+		off_t		off,
+		unsigned char *	p,
+		size_t		len
+			)
+{
+	if ( !building || nhdr.sumlen || nhdr.nfiles )
+		return;
+
+	nhdr.sumoff = off;
+	nhdr.sumlen = len;
+	nhdr.sumsum = idx_sum (p, len);
+	idx_adddata (p, len);
+}
+
+/*
+ *  A file record, LEN bytes at P.
+ */
+void	idx_addfile	(
+		unsigned char *	p,
+		size_t		len
+			)
+{
+IDX_FILE	*fp;
+
+	if ( !building )
+		return;
+
+	nfiles_idx = idx_grow (nfiles_idx, &afiles_idx, nhdr.nfiles, sizeof (IDX_FILE));
+	fp = &nfiles_idx [nhdr.nfiles++];
+	fp->recoff = idx_adddata (p, len);
+	fp->reclen = len;
+	fp->first = nhdr.nranges;
+	fp->count = 0;
+}
+
+/*
+ *  A VBN record of the last file, starting at VBN: LEN bytes at offset
+ *  RECOFF of the block at offset BLKOFF of the saveset.
+ */
+void	idx_addvbn	(
+		off_t		blkoff,
+		int		recoff,
+		int		len,
+		unsigned	vbn
+			)
+{
+IDX_RANGE	*rp;
+
+	if ( !building || !nhdr.nfiles )
+		return;
+
+	nranges_idx = idx_grow (nranges_idx, &aranges_idx, nhdr.nranges, sizeof (IDX_RANGE));
+	rp = &nranges_idx [nhdr.nranges++];
+	rp->blkoff = blkoff;
+	rp->recoff = recoff;
+	rp->len = len;
+	rp->vbn = vbn;
+	rp->spare = 0;
+
+	nfiles_idx [nhdr.nfiles - 1].count++;
+}
+
+static int	idx_write	(
+		int		fd,
+		void *		p,
+		size_t		len
+			)
+{
+	return	len && len != write (fd, p, len);
+}
+
+/*
+ *  Write out the index built for SAVESET (descriptor FD), which has
+ *  been read to the end.  A new index replaces the old one only once it
+ *  is complete.
+ */
+void	idx_save	(
+		char *	saveset,
+		int	fd
+			)
+{
+char	*path, *tmp;
+struct	stat	st;
+int	ofd, status;
+
+	if ( !building )
+		return;
+
+	building = 0;
+
+	path = idx_path (saveset);
+	tmp = idx_path (path);
+
+	if ( fstat (fd, &st) )
+		{
+		perror (saveset);
+		goto	done;
+		}
+
+	memcpy (nhdr.magic, IDX_MAGIC, sizeof (nhdr.magic));
+	nhdr.version	= IDX_VERSION;
+	nhdr.order	= IDX_ORDER;
+	nhdr.size	= st.st_size;
+	nhdr.mtime	= st.st_mtime;
+	nhdr.blocksize	= blocksize;
+	nhdr.filesoff	= sizeof (IDX_HDR);
+	nhdr.rangesoff	= nhdr.filesoff + nhdr.nfiles * sizeof (IDX_FILE);
+	nhdr.dataoff	= nhdr.rangesoff + nhdr.nranges * sizeof (IDX_RANGE);
+
+	if ( 0 > (ofd = open (tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666)) )
+		{
+		perror (tmp);
+		goto	done;
+		}
+
+	status = idx_write (ofd, &nhdr, sizeof (IDX_HDR))
+		|| idx_write (ofd, nfiles_idx, nhdr.nfiles * sizeof (IDX_FILE))
+		|| idx_write (ofd, nranges_idx, nhdr.nranges * sizeof (IDX_RANGE))
+		|| idx_write (ofd, ndata, nhdr.datalen);
+
+	if ( close (ofd) || status || rename (tmp, path) )
+		{
+		perror (path);
+		unlink (tmp);
+		}
+	else if ( vflag )
+		printf ("Index written to %s, %u files\n", path, nhdr.nfiles);
+
+done:
+	free (tmp);
+	free (path);
+}
@@ -0,0 +1,956 @@
+/*
+ *
+ *  Title:
+ *	Saveset input
+ *
+ *  Description:
+ *	Block input layer for VMSBACKUP.  The main loop and the label
+ *	routines ask for the next LEN bytes and get back a pointer to them,
+ *	with the same return convention as read (): a byte count, 0 at a
+ *	file mark/end of file, -1 on error.
+ *
+ *	For savesets on disk the whole file can be mapped into memory (the
+ *	-m option), in which case the pointer we hand back points straight
+ *	into the mapping: no copy and no system call per block.  Otherwise
+ *	we read () into a private buffer, as vmsbackup always did.
+ *
+ *	With -r a producer thread keeps a ring of blocks read ahead of the
+ *	parser, so that reading and decoding overlap instead of each
+ *	waiting for the other.
+ *
+ *	With -T the same ring streams a tape: one tape record per slot, file
+ *	marks kept as empty slots, and the reader stopping only when the
+ *	buffer reaches the high-water mark and not starting again until it
+ *	has drained to the low-water mark, so the drive runs in long bursts
+ *	rather than stopping and repositioning for every block.
+ *
+ *	Tapes also keep a position: the logical block number on a real
+ *	drive (as MTIOCPOS reports it, file marks counting as a block), or
+ *	the byte offset in a SIMH-format tape image, which stands in for a
+ *	tape drive wherever one is accepted.  The tape catalogue (catalog.c)
+ *	records these positions and MTSEEKs back to them later.
+ *
+ */
+
+/* Does this system have the magnetic tape ioctls?  See vmsbackup.c.  */
+#ifndef HAVE_MT_IOCTLS
+#define HAVE_MT_IOCTLS 1
+#endif
+
+#ifdef HAVE_UNIXIO_H
+#include	<unixio.h>
+#else
+#include	<unistd.h>
+#include	<fcntl.h>
+#endif
+
+#include	<stdio.h>
+#include	<errno.h>
+#include	<stdlib.h>
+#include	<string.h>
+
+#include	<sys/types.h>
+#include	<sys/stat.h>
+#if HAVE_MT_IOCTLS
+#include	<sys/ioctl.h>
+#include	<sys/mtio.h>
+#endif
+#ifndef	NO_MMAP
+#include	<sys/mman.h>
+#endif
+#ifndef	NO_THREADS
+#include	<pthread.h>
+#endif
+
+#include	"vmsbackup.h"
+
+static off_t	inp_drivepos (BCK_INPUT *ip);
+
+#ifndef	MAX
+#define	MAX(a, b)	((a) > (b) ? (a) : (b))
+#endif
+#ifndef	MIN
+#define	MIN(a, b)	((a) < (b) ? (a) : (b))
+#endif
+
+#ifndef	NO_THREADS
+/*
+ *  Read-ahead ring.  Slots are numbered by an ever increasing count; slot
+ *  N lives in mem [(N % depth) * slotsz].  The producer owns slots
+ *  [head, tail + depth), the consumer owns [tail, head).  A slot with
+ *  len == 0 is end of file (a file mark on tape), len == -1 a read error
+ *  (errno in err).
+ *
+ *  The producer stops when it holds HIGH slots and resumes once the
+ *  consumer has drained the ring down to LOW.  For disk savesets LOW is
+ *  just HIGH - 1.
+ */
+typedef struct __bck_ring {
+	pthread_t	thread;
+	pthread_mutex_t	lock;
+	pthread_cond_t	notempty,	/* producer -> consumer */
+			notfull;	/* consumer -> producer */
+
+	int		fd;
+	int		tape;		/* one record per slot, see above */
+	int		image;		/* ... read from a SIMH tape image */
+	int		depth,
+			slotsz,
+			high,
+			low;
+	char *		mem;
+	int *		len;
+	int *		err;
+
+	unsigned long	head,		/* next slot the producer fills */
+			tail,		/* oldest slot the consumer holds */
+			cur;		/* slot the consumer cursor is in */
+	int		off;		/* ... and offset within it */
+
+	off_t		start;		/* file offset of slot 0 */
+	off_t		tpos;		/* tape position of the next read */
+	off_t *		npos;		/* tape position after each slot */
+	unsigned long	last;		/* tape: slot of the last record returned */
+	off_t		lastpos,	/* ... and its offset in the byte count */
+			lasttpos;	/* ... and its tape position */
+	int		done,		/* producer hit end of file or error */
+			stop;		/* consumer wants the producer gone */
+
+	/* Statistics for the verbose report.  */
+	unsigned long	nget,		/* slots the consumer has entered */
+			fillsum,	/* sum of ring occupancy at each of those */
+			cwaits,		/* consumer found the ring empty */
+			pwaits;		/* producer stopped at high water */
+} BCK_RING;
+#endif
+
+/*
+ *  Try to map the saveset file.  Returns 1 on success; on any failure we
+ *  quietly stay with read () - a saveset on a pipe or a 32-bit address
+ *  space too small for the file is not an error.
+ */
+static int	inp_map	(
+		BCK_INPUT *	ip
+			)
+{
+#ifndef	NO_MMAP
+struct stat	st;
+void	*p;
+
+	if ( fstat (ip->fd, &st) || !S_ISREG (st.st_mode) || !st.st_size )
+		return	0;
+
+	if ( (off_t) (size_t) st.st_size != st.st_size )
+		return	0;
+
+	if ( MAP_FAILED == (p = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, ip->fd, 0)) )
+		{
+		if ( vflag )
+			perror ("mmap of saveset failed, using read");
+		return	0;
+		}
+
+	/* We walk the saveset front to back exactly once (scan_bbh ()
+	   only ever moves a block or so backwards); tell the kernel so it
+	   can read ahead aggressively and drop pages behind us.  */
+#ifdef	MADV_SEQUENTIAL
+	madvise (p, st.st_size, MADV_SEQUENTIAL);
+#endif
+#ifdef	MADV_HUGEPAGE
+	madvise (p, st.st_size, MADV_HUGEPAGE);
+#endif
+
+	ip->map = p;
+	ip->mapsz = st.st_size;
+
+	return	1;
+#else
+	return	0;
+#endif
+}
+
+/*
+ *  Read one record from a tape into BUF, which holds LEN bytes, the way
+ *  read () on a tape drive does: the record length, 0 at a file mark,
+ *  -1 on error.  A longer record is truncated.  *POSP is the tape
+ *  position, which we advance.
+ *
+ *  A SIMH tape image is a sequence of records, each a 4-byte
+ *  little-endian length, the data padded to an even length and the
+ *  length again; a length of 0 is a file mark and 0xffffffff the end
+ *  of the medium.
+ */
+static int	tape_read	(
+		int	fd,
+		int	image,
+		off_t *	posp,
+		char *	buf,
+		int	len
+			)
+{
+unsigned char	hdr [4];
+unsigned	reclen;
+int	n;
+
+	if ( !image )
+		{
+		while ( 0 > (n = read (fd, buf, len)) && errno == EINTR )
+			;
+
+		if ( n >= 0 )
+			++*posp;
+
+		return	n;
+		}
+
+	if ( sizeof (hdr) != (n = pread (fd, hdr, sizeof (hdr), *posp)) )
+		return	n < 0 ? -1 : 0;
+
+	reclen = hdr [0] | (hdr [1] << 8) | (hdr [2] << 16) | ((unsigned) hdr [3] << 24);
+
+	if ( reclen == 0xffffffff )
+		return	0;
+
+	if ( !reclen )
+		{
+		*posp += sizeof (hdr);
+		return	0;
+		}
+
+	/* The top bits are error flags; take the data anyway.  */
+	reclen &= 0x00ffffff;
+	n = MIN (reclen, (unsigned) len);
+
+	if ( n != pread (fd, buf, n, *posp + sizeof (hdr)) )
+		{
+		errno = EIO;
+		return	-1;
+		}
+
+	*posp += 2 * sizeof (hdr) + reclen + (reclen & 1);
+
+	return	n;
+}
+
+/*
+ *  Move a tape to position POS.
+ */
+static int	tape_seek	(
+		int	fd,
+		int	image,
+		off_t	pos
+			)
+{
+#if HAVE_MT_IOCTLS
+struct	mtop	op;
+#endif
+
+	if ( image )
+		return	0;
+
+#if HAVE_MT_IOCTLS
+	op.mt_op = MTSEEK;
+	op.mt_count = pos;
+
+	return	ioctl(fd, MTIOCTOP, &op);
+#else
+	errno = ENOTTY;
+	return	-1;
+#endif
+}
+
+#ifndef	NO_THREADS
+/*
+ *  The producer: fill slots from the saveset until end of file, an error
+ *  or until the consumer tells us to stop.
+ */
+static void *	ring_producer	(
+		void *	arg
+			)
+{
+BCK_RING *	rp = arg;
+char	*p;
+int	n, status, err, marks = 0;
+
+	pthread_mutex_lock (&rp->lock);
+
+	while ( !rp->stop )
+		{
+		if ( rp->head - rp->tail >= rp->high )
+			{
+			rp->pwaits++;
+
+			while ( !rp->stop && rp->head - rp->tail > rp->low )
+				pthread_cond_wait (&rp->notfull, &rp->lock);
+
+			continue;
+			}
+
+		p = rp->mem + (rp->head % rp->depth) * rp->slotsz;
+		pthread_mutex_unlock (&rp->lock);
+
+		if ( rp->tape )
+			{
+			/* A tape read gives us one record, or 0 at a file
+			   mark.  Two file marks in a row are the logical
+			   end of the tape.  */
+			n = tape_read (rp->fd, rp->image, &rp->tpos, p, rp->slotsz);
+
+			err = n < 0 ? errno : 0;
+			marks = n ? 0 : marks + 1;
+
+			pthread_mutex_lock (&rp->lock);
+
+			rp->len [rp->head % rp->depth] = n;
+			rp->err [rp->head % rp->depth] = err;
+			rp->npos [rp->head % rp->depth] = rp->tpos;
+			rp->head++;
+
+			pthread_cond_signal (&rp->notempty);
+
+			if ( n < 0 || marks == 2 )
+				break;
+
+			continue;
+			}
+
+		/* A read from NFS or a pipe may come back short; keep going
+		   until the slot is full so that slots stay block aligned.  */
+		for (n = 0, err = 0; n < rp->slotsz; n += status)
+			if ( 0 >= (status = read (rp->fd, p + n, rp->slotsz - n)) )
+				{
+				if ( status < 0 && errno == EINTR )
+					{
+					status = 0;
+					continue;
+					}
+
+				if ( status < 0 && !n )
+					{
+					n = -1;
+					err = errno;
+					}
+				break;
+				}
+
+		pthread_mutex_lock (&rp->lock);
+
+		rp->len [rp->head % rp->depth] = n;
+		rp->err [rp->head % rp->depth] = err;
+		rp->head++;
+
+		pthread_cond_signal (&rp->notempty);
+
+		if ( n < rp->slotsz )
+			break;
+		}
+
+	rp->done = 1;
+	pthread_cond_signal (&rp->notempty);
+	pthread_mutex_unlock (&rp->lock);
+
+	return	NULL;
+}
+
+/*
+ *  (Re)start the producer with an empty ring at file offset POS (for a
+ *  tape: at tape position POS, where the tape already is).
+ */
+static int	ring_start	(
+		BCK_RING *	rp,
+		off_t		pos
+			)
+{
+	if ( rp->tape )
+		rp->tpos = pos;
+	else if ( 0 > lseek (rp->fd, pos, SEEK_SET) && pos )
+		return	-1;
+
+	rp->start = pos;
+	rp->head = rp->tail = rp->cur = 0;
+	rp->off = rp->done = rp->stop = 0;
+
+	if ( (errno = pthread_create (&rp->thread, NULL, ring_producer, rp)) )
+		return	-1;
+
+	return	0;
+}
+
+static void	ring_stop	(
+		BCK_RING *	rp
+			)
+{
+	pthread_mutex_lock (&rp->lock);
+	rp->stop = 1;
+	pthread_cond_signal (&rp->notfull);
+	pthread_mutex_unlock (&rp->lock);
+
+	pthread_join (rp->thread, NULL);
+}
+
+/*
+ *  Set up a ring of DEPTH slots of SLOTSZ bytes on FD.  Returns NULL (and
+ *  the caller reads synchronously) if we cannot get the memory or thread.
+ */
+static BCK_RING *	ring_create	(
+		BCK_INPUT *	ip,
+		int	depth,
+		int	slotsz
+			)
+{
+BCK_RING *	rp;
+
+	if ( !(rp = calloc (1, sizeof (BCK_RING))) )
+		return	NULL;
+
+	rp->fd = ip->fd;
+	rp->tape = !ip->ondisk;
+	rp->image = ip->image;
+	rp->depth = depth;
+	rp->slotsz = slotsz;
+
+	if ( rp->tape )
+		{
+		rp->high = MAX (1, (depth * highwater) / 100);
+		rp->low = MIN (rp->high - 1, (depth * lowwater) / 100);
+		}
+	else	{
+		rp->high = depth;
+		rp->low = depth - 1;
+		}
+
+	if ( !(rp->mem = malloc ((size_t) depth * slotsz))
+		|| !(rp->len = calloc (depth, sizeof (int)))
+		|| !(rp->err = calloc (depth, sizeof (int)))
+		|| !(rp->npos = calloc (depth, sizeof (off_t))) )
+		{
+		free (rp->mem); free (rp->len); free (rp->err); free (rp);
+		return	NULL;
+		}
+
+	pthread_mutex_init (&rp->lock, NULL);
+	pthread_cond_init (&rp->notempty, NULL);
+	pthread_cond_init (&rp->notfull, NULL);
+
+	if ( ring_start (rp, rp->tape ? ip->tpos : MAX (0, lseek (rp->fd, 0, SEEK_CUR))) )
+		{
+		perror ("read-ahead thread");
+		free (rp->mem); free (rp->len); free (rp->err); free (rp->npos); free (rp);
+		return	NULL;
+		}
+
+	return	rp;
+}
+
+/*
+ *  Make slot rp->cur available to the consumer, waiting for the producer
+ *  if need be, and hand back everything before it.  Returns 0 when the
+ *  slot exists, -1 when the producer has stopped before filling it.
+ *  Called with the lock held.
+ */
+static int	ring_enter	(
+		BCK_RING *	rp
+			)
+{
+	if ( rp->tail < rp->cur )
+		{
+		rp->tail = rp->cur;
+		pthread_cond_signal (&rp->notfull);
+		}
+
+	if ( rp->cur >= rp->head && !rp->done )
+		{
+		/* The wait for the very first slot is not an underrun.  */
+		if ( rp->nget )
+			rp->cwaits++;
+
+		while ( rp->cur >= rp->head && !rp->done )
+			pthread_cond_wait (&rp->notempty, &rp->lock);
+		}
+
+	return	rp->cur < rp->head ? 0 : -1;
+}
+
+/*
+ *  inp_read () for the ring.  A request which lies inside one slot (the
+ *  usual case: slots are exactly one block) is returned in place; one
+ *  which straddles slots is gathered into the staging buffer.
+ */
+static int	ring_read	(
+		BCK_INPUT *	ip,
+		char **		bufp,
+		int		len
+			)
+{
+BCK_RING *	rp = ip->ring;
+int	n = 0, slot, chunk;
+
+	pthread_mutex_lock (&rp->lock);
+
+	/* On tape every read () returns (at most) one record, and a file
+	   mark is returned as 0 and then stepped over, as the driver
+	   would do.  */
+	if ( rp->tape )
+		{
+		if ( !ring_enter (rp) )
+			{
+			slot = rp->cur % rp->depth;
+
+			rp->nget++;
+			rp->fillsum += rp->head - rp->cur;
+
+			if ( (n = rp->len [slot]) < 0 )
+				errno = rp->err [slot];
+
+			n = MIN (n, len);
+			*bufp = rp->mem + slot * rp->slotsz;
+
+			rp->last = rp->cur++;
+			rp->lastpos = ip->pos;
+			rp->lasttpos = ip->tpos;
+			ip->tpos = rp->npos [slot];
+			}
+
+		pthread_mutex_unlock (&rp->lock);
+
+		if ( n > 0 )
+			ip->pos += n;
+
+		return	n;
+		}
+
+	while ( n < len )
+		{
+		if ( ring_enter (rp) )
+			break;
+
+		slot = rp->cur % rp->depth;
+
+		if ( !rp->off )
+			{
+			rp->nget++;
+			rp->fillsum += rp->head - rp->cur;
+			}
+
+		if ( rp->len [slot] <= 0 )
+			{
+			if ( !n && rp->len [slot] < 0 )
+				{
+				errno = rp->err [slot];
+				n = -1;
+				}
+			break;
+			}
+
+		chunk = rp->len [slot] - rp->off;
+		if ( chunk > len - n )
+			chunk = len - n;
+
+		if ( !n && chunk == len )
+			*bufp = rp->mem + slot * rp->slotsz + rp->off;
+		else	{
+			if ( !n )
+				*bufp = ip->buf;
+
+			memcpy (ip->buf + n, rp->mem + slot * rp->slotsz + rp->off, chunk);
+			}
+
+		n += chunk;
+
+		if ( (rp->off += chunk) == rp->len [slot] )
+			{
+			rp->cur++;
+			rp->off = 0;
+			}
+		}
+
+	pthread_mutex_unlock (&rp->lock);
+
+	if ( n > 0 )
+		ip->pos += n;
+
+	return	n;
+}
+
+/*
+ *  Seek within the ring.  Anything from the oldest slot we still hold up
+ *  to what the producer has read is just a cursor move; otherwise stop
+ *  the producer and restart it at the new offset.
+ */
+static int	ring_seek	(
+		BCK_INPUT *	ip,
+		off_t		pos
+			)
+{
+BCK_RING *	rp = ip->ring;
+off_t	first, rel;
+int	status = 0;
+
+	pthread_mutex_lock (&rp->lock);
+
+	/* A tape can only back up to the start of the record it just
+	   returned, which is what scan_bbh () needs.  */
+	if ( rp->tape )
+		{
+		if ( rp->cur == rp->last + 1 && pos >= rp->lastpos && pos < ip->pos )
+			{
+			rp->cur = rp->last;
+			ip->pos = rp->lastpos;
+			ip->tpos = rp->lasttpos;
+			}
+		else	status = -1;
+
+		pthread_mutex_unlock (&rp->lock);
+
+		return	status;
+		}
+
+	first = rp->start + (off_t) rp->tail * rp->slotsz;
+	rel = pos - rp->start;
+
+	if ( pos >= first && rel / rp->slotsz < rp->head
+		&& rp->len [(rel / rp->slotsz) % rp->depth] > rel % rp->slotsz )
+		{
+		rp->cur = rel / rp->slotsz;
+		rp->off = rel % rp->slotsz;
+		pthread_mutex_unlock (&rp->lock);
+		}
+	else	{
+		pthread_mutex_unlock (&rp->lock);
+
+		ring_stop (rp);
+		status = ring_start (rp, pos);
+		}
+
+	if ( !status )
+		ip->pos = pos;
+
+	return	status;
+}
+
+static void	ring_destroy	(
+		BCK_RING *	rp
+			)
+{
+	ring_stop (rp);
+
+	/* The underrun count is what one sizes -T by, so report it for
+	   every tape run, on stderr to keep listings clean.  */
+	if ( rp->tape && rp->nget )
+		fprintf (stderr, "Tape buffer: %lu MB in %d records, average occupancy %.1f, "
+			"%lu underruns, drive stopped %lu times\n",
+			((unsigned long) rp->depth * rp->slotsz) >> 20, rp->depth,
+			(double) rp->fillsum / rp->nget, rp->cwaits, rp->pwaits);
+	else if ( vflag && rp->nget )
+		printf ("Read-ahead: %d blocks deep, average occupancy %.1f, "
+			"parser waited %lu times, reader waited %lu times\n",
+			rp->depth, (double) rp->fillsum / rp->nget,
+			rp->cwaits, rp->pwaits);
+
+	pthread_mutex_destroy (&rp->lock);
+	pthread_cond_destroy (&rp->notempty);
+	pthread_cond_destroy (&rp->notfull);
+
+	free (rp->mem);
+	free (rp->len);
+	free (rp->err);
+	free (rp->npos);
+	free (rp);
+}
+#endif
+
+/*
+ *  Get the staging buffer up to LEN bytes.
+ */
+static void	inp_buffer	(
+		BCK_INPUT *	ip,
+		int		len
+			)
+{
+	if ( len <= ip->bufsz )
+		return;
+
+	free (ip->buf);
+
+	if ( !(ip->buf = malloc (len)) )
+		{
+		fprintf(stderr, "memory allocation for block failed\n");
+		exit(1);
+		}
+
+	ip->bufsz = len;
+}
+
+/*
+ *  Set up the input layer on an already opened saveset, which KIND says
+ *  is a file on disk, a (rewound) tape or a tape image.  MAPIT asks for
+ *  the memory-mapped mode, which we only honour for savesets on disk.
+ *  DEPTH, if nonzero, is the number of BLKSZ blocks to read ahead in a
+ *  separate thread; that is used if the saveset could not be mapped.
+ *  On tape BLKSZ must be at least the largest record we may meet.
+ */
+void	inp_open	(
+		BCK_INPUT *	ip,
+		int		fd,
+		int		kind,
+		int		mapit,
+		int		depth,
+		int		blksz
+			)
+{
+	memset (ip, 0, sizeof (BCK_INPUT));
+
+	ip->fd = fd;
+	ip->ondisk = kind == INP_K_DISK;
+	ip->image = kind == INP_K_IMAGE;
+
+	if ( ip->ondisk && mapit && inp_map (ip) )
+		return;
+
+#ifndef	NO_THREADS
+	if ( depth > 0 && blksz > 0 )
+		{
+		inp_buffer (ip, blksz);
+		ip->ring = ring_create (ip, depth, blksz);
+		}
+#endif
+}
+
+/*
+ *  Skip forward over the next file mark on tape.  With the tape ring the
+ *  drive keeps streaming and we just drop records up to the mark.
+ *  Returns -1 on error.
+ */
+int	inp_skipfile	(
+		BCK_INPUT *	ip
+			)
+{
+#if HAVE_MT_IOCTLS
+struct	mtop	op;
+#endif
+char	*bufp, dummy [80];
+int	status;
+
+#ifndef	NO_THREADS
+	if ( ip->ring )
+		{
+		while ( 0 < (status = ring_read (ip, &bufp, ip->bufsz)) )
+			;
+
+		return	status;
+		}
+#endif
+
+	if ( ip->image )
+		{
+		while ( 0 < (status = tape_read (ip->fd, 1, &ip->tpos, dummy, sizeof (dummy))) )
+			;
+
+		return	status;
+		}
+
+#if HAVE_MT_IOCTLS
+	op.mt_op = MTFSF;
+	op.mt_count = 1;
+
+	if ( 0 > (status = ioctl(ip->fd, MTIOCTOP, &op)) )
+		return	status;
+
+	ip->tpos = inp_drivepos (ip);
+
+	return	status;
+#else
+	abort ();
+#endif
+}
+
+/*
+ *  Ask the drive where it is; -1 if it cannot tell us.
+ */
+static off_t	inp_drivepos	(
+		BCK_INPUT *	ip
+			)
+{
+#if HAVE_MT_IOCTLS && defined (MTIOCPOS)
+struct	mtpos	pos;
+
+	if ( !ioctl (ip->fd, MTIOCPOS, &pos) )
+		return	pos.mt_blkno;
+#endif
+	return	-1;
+}
+
+/*
+ *  Tape position of the next record inp_read () will return, for the
+ *  tape catalogue; -1 if unknown (or for a saveset on disk).
+ */
+off_t	inp_tapepos	(
+		BCK_INPUT *	ip
+			)
+{
+	return	ip->ondisk ? -1 : ip->tpos;
+}
+
+/*
+ *  Position a tape at POS, as returned by inp_tapepos () earlier.
+ *  Returns -1 on error.
+ */
+int	inp_tapeseek	(
+		BCK_INPUT *	ip,
+		off_t		pos
+			)
+{
+	if ( ip->ondisk || pos < 0 )
+		return	-1;
+
+#ifndef	NO_THREADS
+	if ( ip->ring )
+		{
+		ring_stop (ip->ring);
+
+		if ( tape_seek (ip->fd, ip->image, pos) )
+			return	-1;
+
+		ip->tpos = pos;
+
+		return	ring_start (ip->ring, pos);
+		}
+#endif
+
+	if ( tape_seek (ip->fd, ip->image, pos) )
+		return	-1;
+
+	ip->tpos = pos;
+
+	return	0;
+}
+
+/*
+ *  Get the next LEN bytes of the saveset.  *BUFP is set to point at the
+ *  data, which stays valid until the next call.  Returns the byte count
+ *  as read () would.
+ */
+int	inp_read	(
+		BCK_INPUT *	ip,
+		char **		bufp,
+		int		len
+			)
+{
+int	status;
+
+	if ( ip->map )
+		{
+		if ( (size_t) ip->pos >= ip->mapsz )
+			return	0;
+
+		if ( (size_t) len > ip->mapsz - ip->pos )
+			len = ip->mapsz - ip->pos;
+
+		*bufp = (char *) ip->map + ip->pos;
+		ip->pos += len;
+
+		return	len;
+		}
+
+	inp_buffer (ip, len);
+
+#ifndef	NO_THREADS
+	if ( ip->ring )
+		return	ring_read (ip, bufp, len);
+#endif
+
+	if ( ip->ondisk )
+		status = read (ip->fd, ip->buf, len);
+	else	status = tape_read (ip->fd, ip->image, &ip->tpos, ip->buf, len);
+
+	if ( 0 < status )
+		ip->pos += status;
+
+	*bufp = ip->buf;
+
+	return	status;
+}
+
+/*
+ *  Offset of the next byte inp_read () will return.
+ */
+off_t	inp_tell	(
+		BCK_INPUT *	ip
+			)
+{
+	return	ip->pos;
+}
+
+/*
+ *  Reposition the input; used by scan_bbh () to back up to a block
+ *  header it has found.  Returns -1 on error.
+ */
+int	inp_seek	(
+		BCK_INPUT *	ip,
+		off_t		pos
+			)
+{
+#ifndef	NO_THREADS
+	if ( ip->ring )
+		return	ring_seek (ip, pos);
+#endif
+
+	if ( !ip->map && 0 > lseek (ip->fd, pos, SEEK_SET) )
+		return	-1;
+
+	ip->pos = pos;
+
+	return	0;
+}
+
+/*
+ *  Get LEN bytes at offset OFF of a saveset on disk, without moving the
+ *  input along: for reading single blocks through the saveset index.
+ *  Returns the byte count as pread () would.
+ */
+int	inp_pread	(
+		BCK_INPUT *	ip,
+		char **		bufp,
+		int		len,
+		off_t		off
+			)
+{
+	if ( ip->map )
+		{
+		if ( off < 0 || (size_t) off >= ip->mapsz )
+			return	0;
+
+		if ( (size_t) len > ip->mapsz - off )
+			len = ip->mapsz - off;
+
+		*bufp = (char *) ip->map + off;
+
+		return	len;
+		}
+
+	inp_buffer (ip, len);
+
+	*bufp = ip->buf;
+
+	return	pread (ip->fd, ip->buf, len, off);
+}
+
+void	inp_close	(
+		BCK_INPUT *	ip
+			)
+{
+#ifndef	NO_MMAP
+	if ( ip->map )
+		munmap (ip->map, ip->mapsz);
+#endif
+#ifndef	NO_THREADS
+	if ( ip->ring )
+		ring_destroy (ip->ring);
+#endif
+	free (ip->buf);
+
+	close (ip->fd);
+
+	memset (ip, 0, sizeof (BCK_INPUT));
+	ip->fd = -1;
+}
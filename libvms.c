@@ -0,0 +1,774 @@
+/*
+ *
+ *  Title:
+ *	Saveset decoding library
+ *
+ *  Description:
+ *	The core of vmsbackup as a library (libvmsbackup.a and .so, with
+ *	libvmsbackup.h) for programs which decode savesets themselves:
+ *
+ *		VB_CTX *ctx = vb_open (fd, flags, &callbacks, arg);
+ *
+ *		while ( (n = vb_step (ctx)) > 0 )
+ *			;
+ *
+ *		vb_close (ctx);
+ *
+ *	vb_step () reads and decodes one block, calling back with the
+ *	summary, each file header and the data of the files wanted; where
+ *	the blocks come from some other way, vb_block () decodes one held
+ *	in memory, and vb_feed () takes the saveset in pieces of any size,
+ *	as they arrive, ending with vb_finish ().  The state of a saveset
+ *	is all in its VB_CTX, errors are returned, and nothing is printed.
+ *
+ *	vb_fileattr () (the items of a file header) and vb_convert () (the
+ *	data of a file from its record format) are the same code
+ *	vmsbackup's process_file () and process_vbn () use.
+ *
+ *	What the library does not do is what needs a tape drive or the
+ *	whole command: tape labels, redundancy group rebuilds, catalogues
+ *	and indexes, writing files.
+ *
+ */
+
+#ifdef HAVE_UNIXIO_H
+#include	<unixio.h>
+#else
+#include	<unistd.h>
+#endif
+
+#include	<stdio.h>
+#include	<errno.h>
+#include	<stdlib.h>
+#include	<string.h>
+
+#include	<sys/types.h>
+
+#include	"fabdef.h"
+#include	"vmsbackup.h"
+#include	"libvmsbackup.h"
+
+/* Block header and record header sizes, and offsets in them (see
+   BCK_BLK_HDR and BCK_REC_HDR in vmsbackup.c).  */
+#define	VB_BBH_SZ	256
+#define	VB_BRH_SZ	16
+#define	VB_BBH_APPLIC	6
+#define	VB_BBH_BLKSIZE	40
+#define	VB_BRH_RTYPE	2
+
+/* Record types.  */
+#define	VB_K_SUMMARY	1
+#define	VB_K_FILE	3
+#define	VB_K_VBN	4
+
+struct __vb_ctx {
+	int		fd;
+	int		flags;
+	VB_CALLBACKS	cb;
+	void *		arg;
+
+	unsigned char *	buf;		/* a block */
+	size_t		blocksize;	/* 0 until the first block is read */
+
+	/* vb_feed (): the first block header until the block size is known,
+	   how much of the block in BUF there is, how far it has been
+	   decoded (all of it when it is not to be), and the size of its
+	   contents.  */
+	unsigned char	hdr [VB_BBH_SZ];
+	size_t		have;
+	size_t		done;
+	size_t		bsize;
+
+	VB_FILE		file;		/* the current file */
+	int		infile;		/* there is one */
+	int		want;		/* its data goes to cb.data */
+	VB_CONV		conv;
+};
+
+static const char	*vb_errors [] = {
+	"no error",
+	"read error",
+	"out of memory",
+	"not a BACKUP block",
+	"block failed its CRC check",
+	"saveset ends inside a block",
+	"record format not supported",
+	"stopped by the caller"
+	};
+
+static unsigned	vb_uw	(
+		const unsigned char *	p
+			)
+{
+	return	p [0] | p [1] << 8;
+}
+
+static unsigned	vb_ul	(
+		const unsigned char *	p
+			)
+{
+	return	p [0] | p [1] << 8 | p [2] << 16 | (unsigned) p [3] << 24;
+}
+
+/*
+ *  Once, before any other call (and before any threads are started).
+ */
+void	vb_init	(void)
+{
+	crc_init ();
+}
+
+/*
+ *  The message for the error ERR.
+ */
+const char *	vb_strerror	(
+		int	err
+			)
+{
+	if ( err > 0 || -err >= (int) (sizeof (vb_errors) / sizeof (vb_errors [0])) )
+		return	"unknown error";
+
+	return	vb_errors [-err];
+}
+
+/*
+ *  Take the file header record REC of LEN bytes apart into *FP.  Returns
+ *  VB_E_FORMAT if it is not one.
+ */
+int	vb_fileattr	(
+		VB_FILE *		fp,
+		const unsigned char *	rec,
+		size_t			len
+			)
+{
+const unsigned char	*p;
+size_t	c, itmlen;
+
+	memset (fp, 0, sizeof (VB_FILE));
+	fp->uic_group = fp->uic_member = 0377;
+
+	/* The header word.  */
+	if ( len < 2 || rec [0] != 1 || rec [1] != 1 )
+		return	VB_E_FORMAT;
+
+	for (c = 2; c + 4 <= len; c += itmlen + 4)
+		{
+		itmlen = vb_uw (rec + c);
+		p = rec + c + 4;
+
+		if ( itmlen > len - c - 4 )
+			itmlen = len - c - 4;
+
+		switch (vb_uw (rec + c + 2))
+			{
+			case 0x2a:
+				/* The name.  */
+				memcpy (fp->name, p, itmlen < sizeof (fp->name) ? itmlen : sizeof (fp->name) - 1);
+				break;
+
+			case 0x2c:
+				if ( itmlen >= 6 )
+					{
+					fp->fid [0] = vb_uw (p);
+					fp->fid [1] = vb_uw (p + 2);
+					fp->fid [2] = vb_uw (p + 4);
+					}
+				break;
+
+			case 0x2f:
+				if ( itmlen == 4 )
+					{
+					fp->uic_member = vb_uw (p);
+					fp->uic_group = vb_uw (p + 2);
+					}
+				break;
+
+			case 0x30:
+				if ( itmlen >= 2 )
+					fp->protection = vb_uw (p);
+				break;
+
+			case 0x34:
+				/* The record attributes (FAT).  */
+				if ( itmlen < 20 )
+					break;
+
+				fp->recfmt = p [0];
+				fp->recatt = p [1];
+				fp->recsize = vb_uw (p + 2);
+				fp->ablk = vb_uw (p + 6);
+				fp->nblk = vb_uw (p + 10) + (64 * 1024) * vb_uw (p + 8);
+				fp->lnch = vb_uw (p + 12);
+				fp->vfcsize = p [15] ? p [15] : 2;
+				fp->extension = vb_uw (p + 18);
+				break;
+
+			case 0x35:
+				if ( itmlen >= 2 )
+					fp->revision = vb_uw (p);
+				break;
+
+			case 0x36:
+			case 0x37:
+			case 0x38:
+			case 0x39:
+				if ( itmlen >= 8 )
+					memcpy (vb_uw (rec + c + 2) == 0x36 ? fp->created
+						: vb_uw (rec + c + 2) == 0x37 ? fp->revised
+						: vb_uw (rec + c + 2) == 0x38 ? fp->expires
+						: fp->backup, p, 8);
+				break;
+			}
+		}
+
+	/* "512" is a fixed constant, not the device's block size.  */
+	fp->size = ((long) fp->nblk - 1) * 512 + fp->lnch;
+
+	return	0;
+}
+
+/*
+ *  Start converting the data of the file FP.
+ */
+void	vb_convstart	(
+		VB_CONV *		cp,
+		const VB_FILE *		fp,
+		int			binary
+			)
+{
+	cp->recfmt = fp->recfmt;
+	cp->vfcsize = fp->vfcsize;
+	cp->binary = binary;
+	cp->size = fp->size;
+	cp->count = 0;
+	cp->reclen = 0;
+	cp->hdrlen = 0;
+}
+
+/*
+ *  Convert the LEN bytes at P of a VBN record, passing them to OUT a span
+ *  at a time: a whole record, the rest of the VBN record, or for
+ *  Stream_CR the text up to the next CR.  RECLEN carries a record which
+ *  goes on in the next VBN record; it is an unsigned short, so a VFC
+ *  record shorter than its control area takes the rest of the file.  The
+ *  count and VFC control area of a record may go on in the next VBN
+ *  record too: what there is of them is kept in HDR until they are whole.
+ *  Returns 0, VB_E_RECFMT, or what OUT returned if not 0.
+ */
+int	vb_convert	(
+		VB_CONV *		cp,
+		const unsigned char *	p,
+		size_t			len,
+		VB_OUTFN		out,
+		void *			arg
+			)
+{
+static const unsigned char	nl [] = "\n";
+const unsigned char	*q, *s, *end;
+long	lim, i, n;
+int	status = 0, hsz;
+
+	/* What is left of the file in this record.  */
+	if ( (lim = cp->size - cp->count) > (long) len )
+		lim = len;
+
+	if ( lim <= 0 )
+		return	0;
+
+	switch (cp->recfmt)
+		{
+		case FAB$C_FIX:
+		case FAB$C_STM:
+		case FAB$C_STMLF:
+			status = out (arg, p, lim, 1);
+			i = lim;
+			break;
+
+		case FAB$C_STMCR:
+			if ( cp->binary )
+				{
+				status = out (arg, p, lim, 1);
+				i = lim;
+				break;
+				}
+
+			for (s = p, end = p + lim; !status && s < end; s = q + 1)
+				{
+				if ( !(q = memchr (s, '\r', end - s)) )
+					q = end;
+
+				if ( !(status = out (arg, s, q - s, 0)) && q < end )
+					status = out (arg, nl, 1, 0);
+				}
+
+			i = lim;
+			break;
+
+		case FAB$C_VAR:
+		case FAB$C_VFC:
+			hsz = 2 + (cp->recfmt == FAB$C_VFC ? cp->vfcsize : 0);
+
+			for (i = 0; !status && i < lim; )
+				{
+				if ( !cp->reclen )
+					{
+					n = hsz - cp->hdrlen < lim - i ? hsz - cp->hdrlen : lim - i;
+					memcpy (cp->hdr + cp->hdrlen, p + i, n);
+					cp->hdrlen += n;
+					i += n;
+
+					/* The rest is in the next record.  */
+					if ( cp->hdrlen < hsz )
+						break;
+
+					cp->hdrlen = 0;
+					cp->reclen = vb_uw (cp->hdr);
+
+					if ( cp->binary )
+						status = out (arg, cp->hdr, hsz, 0);
+
+					if ( cp->recfmt == FAB$C_VFC )
+						cp->reclen -= cp->vfcsize;
+					}
+				else	{
+					/* Fortran carriage control is left
+					   in the first byte of the record.  */
+					n = cp->reclen < lim - i ? cp->reclen : lim - i;
+					status = out (arg, p + i, n, 0);
+					i += n;
+					cp->reclen -= n;
+					}
+
+				if ( !cp->reclen && !status )
+					{
+					if ( !cp->binary )
+						status = out (arg, nl, 1, 0);
+
+					if ( i & 1 )
+						{
+						if ( cp->binary && !status && i < lim )
+							status = out (arg, p + i, 1, 0);
+
+						i++;
+						}
+					}
+				}
+			break;
+
+		default:
+			return	VB_E_RECFMT;
+		}
+
+	cp->count += i;
+
+	return	status;
+}
+
+/*
+ *  Open a saveset to be read from FD, decoded with FLAGS (VB_M_) and
+ *  passed to the callbacks CB with ARG.  Returns NULL if out of memory.
+ */
+VB_CTX *	vb_open	(
+		int			fd,
+		int			flags,
+		const VB_CALLBACKS *	cb,
+		void *			arg
+			)
+{
+VB_CTX	*ctx;
+
+	if ( !(ctx = calloc (1, sizeof (VB_CTX))) )
+		return	NULL;
+
+	ctx->fd = fd;
+	ctx->flags = flags;
+	ctx->arg = arg;
+
+	if ( cb )
+		ctx->cb = *cb;
+
+	return	ctx;
+}
+
+/*
+ *  The current file is done with.
+ */
+static int	vb_endfile	(
+		VB_CTX *	ctx
+			)
+{
+	if ( !ctx->infile )
+		return	0;
+
+	ctx->infile = ctx->want = 0;
+
+	if ( ctx->cb.file_end && ctx->cb.file_end (ctx->arg, &ctx->file) )
+		return	VB_E_ABORT;
+
+	return	0;
+}
+
+static int	vb_data	(
+		void *			arg,
+		const unsigned char *	p,
+		size_t			len,
+		int			span
+			)
+{
+VB_CTX	*ctx = arg;
+
+	return	len && ctx->cb.data (ctx->arg, p, len) ? VB_E_ABORT : 0;
+}
+
+/*
+ *  Decode the record of type RTYPE and RSIZE bytes at REC.  Returns 0 or
+ *  an error.
+ */
+static int	vb_record	(
+		VB_CTX *		ctx,
+		unsigned		rtype,
+		const unsigned char *	rec,
+		size_t			rsize
+			)
+{
+int	status;
+
+	switch (rtype)
+		{
+		case VB_K_SUMMARY:
+			if ( ctx->cb.summary && ctx->cb.summary (ctx->arg, rec, rsize) )
+				return	VB_E_ABORT;
+			break;
+
+		case VB_K_FILE:
+			if ( (status = vb_endfile (ctx)) )
+				return	status;
+
+			if ( vb_fileattr (&ctx->file, rec, rsize) )
+				break;
+
+			ctx->infile = 1;
+
+			if ( !ctx->cb.file )
+				ctx->want = 1;
+			else if ( 0 > (ctx->want = ctx->cb.file (ctx->arg, &ctx->file)) )
+				return	VB_E_ABORT;
+
+			vb_convstart (&ctx->conv, &ctx->file, ctx->flags & VB_M_BINARY);
+			break;
+
+		case VB_K_VBN:
+			if ( !ctx->want || !ctx->cb.data )
+				break;
+
+			/* Data we cannot convert is passed over.  */
+			if ( VB_E_ABORT == vb_convert (&ctx->conv, rec, rsize, vb_data, ctx) )
+				return	VB_E_ABORT;
+			break;
+		}
+
+	return	0;
+}
+
+/*
+ *  Check the header of the block of LEN bytes at BLK, and set *BSIZEP to
+ *  the size of its contents.  Returns 1 for a data block, 0 for an XOR
+ *  block (there to rebuild lost ones), or VB_E_FORMAT.
+ */
+static int	vb_header	(
+		const unsigned char *	blk,
+		size_t			len,
+		size_t *		bsizep
+			)
+{
+	if ( len < VB_BBH_SZ || vb_uw (blk) != VB_BBH_SZ )
+		return	VB_E_FORMAT;
+
+	if ( !(*bsizep = vb_ul (blk + VB_BBH_BLKSIZE)) )
+		*bsizep = len;
+
+	if ( *bsizep > len )
+		return	VB_E_FORMAT;
+
+	return	vb_uw (blk + VB_BBH_APPLIC) == 1;
+}
+
+/*
+ *  Decode the block of LEN bytes at BLK.  Returns 1, or an error: after
+ *  VB_E_CRC and VB_E_FORMAT (for this block) the saveset may be carried
+ *  on with.
+ */
+int	vb_block	(
+		VB_CTX *		ctx,
+		const unsigned char *	blk,
+		size_t			len
+			)
+{
+size_t	i, bsize, rsize;
+int	status;
+
+	if ( 0 >= (status = vb_header (blk, len, &bsize)) )
+		return	status ? status : 1;
+
+	if ( (ctx->flags & VB_M_VERIFY) && blk_check ((unsigned char *) blk, bsize) )
+		return	VB_E_CRC;
+
+	for (i = VB_BBH_SZ; i + VB_BRH_SZ <= bsize; i += VB_BRH_SZ + rsize)
+		{
+		if ( (rsize = vb_uw (blk + i)) > bsize - i - VB_BRH_SZ )
+			return	VB_E_FORMAT;
+
+		if ( (status = vb_record (ctx, vb_uw (blk + i + VB_BRH_RTYPE), blk + i + VB_BRH_SZ, rsize)) )
+			return	status;
+		}
+
+	return	1;
+}
+
+/*
+ *  Read LEN bytes into P, as many read ()s as it takes.  Returns the
+ *  number read (less at the end), or -1.
+ */
+static ssize_t	vb_read	(
+		int		fd,
+		unsigned char *	p,
+		size_t		len
+			)
+{
+size_t	got;
+ssize_t	n;
+
+	for (got = 0; got < len; got += n)
+		if ( 0 > (n = read (fd, p + got, len - got)) )
+			{
+			if ( errno == EINTR )
+				{
+				n = 0;
+				continue;
+				}
+
+			return	-1;
+			}
+		else if ( !n )
+			break;
+
+	return	got;
+}
+
+/*
+ *  Read and decode the next block.  Returns 1, 0 at the end of the
+ *  saveset, or an error.
+ */
+int	vb_step	(
+		VB_CTX *	ctx
+			)
+{
+unsigned char	hdr [VB_BBH_SZ];
+ssize_t	n;
+size_t	off = 0;
+
+	if ( !ctx->blocksize )
+		{
+		/* The block size is in the first block header.  */
+		if ( 0 > (n = vb_read (ctx->fd, hdr, sizeof (hdr))) )
+			return	VB_E_READ;
+
+		if ( !n )
+			return	vb_endfile (ctx);
+
+		if ( n < (ssize_t) sizeof (hdr) )
+			return	VB_E_SHORT;
+
+		ctx->blocksize = vb_ul (hdr + VB_BBH_BLKSIZE);
+
+		if ( vb_uw (hdr) != VB_BBH_SZ || ctx->blocksize < VB_BBH_SZ + VB_BRH_SZ )
+			{
+			ctx->blocksize = 0;
+			return	VB_E_FORMAT;
+			}
+
+		if ( !(ctx->buf = malloc (ctx->blocksize)) )
+			return	VB_E_NOMEM;
+
+		memcpy (ctx->buf, hdr, sizeof (hdr));
+		off = sizeof (hdr);
+		}
+
+	if ( 0 > (n = vb_read (ctx->fd, ctx->buf + off, ctx->blocksize - off)) )
+		return	VB_E_READ;
+
+	if ( !(n += off) )
+		return	vb_endfile (ctx);
+
+	if ( n < (ssize_t) ctx->blocksize )
+		return	VB_E_SHORT;
+
+	return	vb_block (ctx, ctx->buf, ctx->blocksize);
+}
+
+/*
+ *  Decode the records of the block in BUF which are all there, as far as
+ *  it has come in through vb_feed ().  Returns 0 or an error, after which
+ *  the rest of the block is passed over.
+ */
+static int	vb_more	(
+		VB_CTX *	ctx
+			)
+{
+const unsigned char	*blk = ctx->buf;
+size_t	rsize;
+int	status;
+
+	if ( !ctx->done )
+		{
+		if ( ctx->have < VB_BBH_SZ )
+			return	0;
+
+		if ( 0 >= (status = vb_header (blk, ctx->blocksize, &ctx->bsize)) )
+			{
+			ctx->done = ctx->blocksize;
+			return	status;
+			}
+
+		ctx->done = VB_BBH_SZ;
+		}
+
+	while ( ctx->done + VB_BRH_SZ <= ctx->bsize && ctx->done + VB_BRH_SZ <= ctx->have )
+		{
+		if ( (rsize = vb_uw (blk + ctx->done)) > ctx->bsize - ctx->done - VB_BRH_SZ )
+			{
+			ctx->done = ctx->blocksize;
+			return	VB_E_FORMAT;
+			}
+
+		if ( ctx->done + VB_BRH_SZ + rsize > ctx->have )
+			break;
+
+		if ( (status = vb_record (ctx, vb_uw (blk + ctx->done + VB_BRH_RTYPE),
+				blk + ctx->done + VB_BRH_SZ, rsize)) )
+			{
+			ctx->done = ctx->blocksize;
+			return	status;
+			}
+
+		ctx->done += VB_BRH_SZ + rsize;
+		}
+
+	return	0;
+}
+
+/*
+ *  Decode the LEN bytes at P, the next of a saveset which comes in pieces
+ *  of any size (from a pipe or a socket, say: CTX is opened with an FD of
+ *  -1).  Whole blocks are decoded where they lie; otherwise what there is
+ *  of a block is kept, and without VB_M_VERIFY each record is decoded as
+ *  soon as all of it has come.  Returns 0, VB_E_ABORT as soon as a
+ *  callback asks, or else the first error of a block (the rest of which
+ *  was passed over) once all of P has been taken.
+ */
+int	vb_feed	(
+		VB_CTX *		ctx,
+		const unsigned char *	p,
+		size_t			len
+			)
+{
+size_t	n;
+int	status, err = 0;
+
+	while ( len )
+		{
+		if ( !ctx->blocksize )
+			{
+			/* The block size is in the first block header.  */
+			n = VB_BBH_SZ - ctx->have < len ? VB_BBH_SZ - ctx->have : len;
+			memcpy (ctx->hdr + ctx->have, p, n);
+			ctx->have += n;
+			p += n;
+			len -= n;
+
+			if ( ctx->have < VB_BBH_SZ )
+				break;
+
+			ctx->blocksize = vb_ul (ctx->hdr + VB_BBH_BLKSIZE);
+
+			if ( vb_uw (ctx->hdr) != VB_BBH_SZ || ctx->blocksize < VB_BBH_SZ + VB_BRH_SZ )
+				{
+				ctx->blocksize = ctx->have = 0;
+				return	VB_E_FORMAT;
+				}
+
+			if ( !(ctx->buf = malloc (ctx->blocksize)) )
+				{
+				ctx->blocksize = ctx->have = 0;
+				return	VB_E_NOMEM;
+				}
+
+			memcpy (ctx->buf, ctx->hdr, VB_BBH_SZ);
+			status = ctx->flags & VB_M_VERIFY ? 0 : vb_more (ctx);
+			}
+		else if ( !ctx->have && len >= ctx->blocksize )
+			{
+			/* A whole block: no need to copy it.  */
+			status = vb_block (ctx, p, ctx->blocksize);
+			p += ctx->blocksize;
+			len -= ctx->blocksize;
+			}
+		else	{
+			n = ctx->blocksize - ctx->have < len ? ctx->blocksize - ctx->have : len;
+			memcpy (ctx->buf + ctx->have, p, n);
+			ctx->have += n;
+			p += n;
+			len -= n;
+
+			status = ctx->flags & VB_M_VERIFY ? 0 : vb_more (ctx);
+			}
+
+		if ( ctx->have == ctx->blocksize )
+			{
+			if ( ctx->flags & VB_M_VERIFY )
+				status = vb_block (ctx, ctx->buf, ctx->blocksize);
+
+			ctx->have = ctx->done = 0;
+			}
+
+		if ( status == VB_E_ABORT )
+			return	status;
+
+		if ( status < 0 && !err )
+			err = status;
+		}
+
+	return	err;
+}
+
+/*
+ *  The end of a saveset given to vb_feed ().  Returns 0, VB_E_SHORT if it
+ *  ended inside a block, or the error of the last FILE_END callback.
+ */
+int	vb_finish	(
+		VB_CTX *	ctx
+			)
+{
+	if ( ctx->have )
+		return	VB_E_SHORT;
+
+	return	vb_endfile (ctx);
+}
+
+/*
+ *  Done with CTX (the descriptor stays open).  Returns 0, or the error
+ *  of the last FILE_END callback.
+ */
+int	vb_close	(
+		VB_CTX *	ctx
+			)
+{
+int	status;
+
+	status = vb_endfile (ctx);
+
+	free (ctx->buf);
+	free (ctx);
+
+	return	status;
+}
@@ -0,0 +1,98 @@
+/* libvmsbackup: decoding VMS BACKUP savesets from a program.  See
+   libvms.c for comments on each function.
+
+   All the state of a saveset being read is in its VB_CTX, so any number
+   of savesets may be decoded at once, from as many threads, once
+   vb_init () has been called.  Nothing here prints or exit ()s: errors
+   come back as the negative VB_E_ codes below.  */
+
+#ifndef	LIBVMSBACKUP_H
+#define	LIBVMSBACKUP_H
+
+#include	<sys/types.h>
+
+/* Errors.  */
+#define	VB_E_READ	-1		/* read () failed: see errno */
+#define	VB_E_NOMEM	-2		/* out of memory */
+#define	VB_E_FORMAT	-3		/* not a valid BACKUP block */
+#define	VB_E_CRC	-4		/* block failed its CRC, dropped */
+#define	VB_E_SHORT	-5		/* saveset ends inside a block */
+#define	VB_E_RECFMT	-6		/* record format not supported */
+#define	VB_E_ABORT	-7		/* a callback asked to stop */
+
+/* Flags to vb_open ().  */
+#define	VB_M_BINARY	1		/* record data as stored */
+#define	VB_M_VERIFY	2		/* drop blocks failing their CRC */
+
+/* The attributes of a file, from its file header record.  Dates are
+   VMS quadwords (100 ns units since 17-Nov-1858), zero if not set.  */
+typedef struct __vb_file {
+	char		name [128];	/* [DIR]NAME.TYPE;VER */
+	unsigned short	fid [3];
+	unsigned short	uic_group, uic_member;
+	unsigned short	protection;
+	unsigned short	revision;
+	unsigned char	recfmt;		/* FAB$C_ format (and organization) */
+	unsigned char	recatt;		/* FAB$M_ attributes */
+	unsigned short	recsize;	/* record size, or the longest */
+	unsigned char	vfcsize;	/* VFC control area */
+	unsigned	nblk;		/* end of file block */
+	unsigned	ablk;		/* blocks allocated */
+	unsigned short	lnch;		/* first free byte of the last block */
+	unsigned short	extension;
+	long		size;		/* bytes of data */
+	unsigned char	created [8], revised [8], expires [8], backup [8];
+} VB_FILE;
+
+/* What vb_step (), vb_block () and vb_feed () call as they decode.
+   Any may be NULL; a nonzero return from one (other than the positive
+   one of FILE) stops the decoding with VB_E_ABORT.  */
+typedef struct __vb_callbacks {
+	/* The saveset summary record.  */
+	int	(*summary) (void *arg, const unsigned char *rec, size_t len);
+
+	/* A file header: return 1 to have DATA called with the file's
+	   data, 0 to pass over it.  */
+	int	(*file) (void *arg, const VB_FILE *fp);
+
+	/* The data of the current file, converted from its record format
+	   as vmsbackup -x would write it (as stored with VB_M_BINARY).  */
+	int	(*data) (void *arg, const unsigned char *p, size_t len);
+
+	/* All of the current file has been seen.  */
+	int	(*file_end) (void *arg, const VB_FILE *fp);
+} VB_CALLBACKS;
+
+/* Converting the data of a file from its record format: the state
+   carried from one VBN record to the next.  */
+typedef struct __vb_conv {
+	int		recfmt;
+	int		vfcsize;
+	int		binary;
+	long		size;		/* of the file */
+	long		count;		/* bytes of it taken so far */
+	unsigned short	reclen;		/* left of a record going on */
+	unsigned short	hdrlen;		/* of a count and VFC area going on */
+	unsigned char	hdr [2 + 255];
+} VB_CONV;
+
+/* Output of vb_convert (): SPAN is nonzero when the bytes are the
+   file's data byte for byte, so that runs of zeros may be holes.  */
+typedef int	(*VB_OUTFN) (void *arg, const unsigned char *p, size_t len, int span);
+
+typedef struct __vb_ctx	VB_CTX;
+
+extern void	vb_init (void);
+extern VB_CTX *	vb_open (int fd, int flags, const VB_CALLBACKS *cb, void *arg);
+extern int	vb_step (VB_CTX *ctx);
+extern int	vb_block (VB_CTX *ctx, const unsigned char *blk, size_t len);
+extern int	vb_feed (VB_CTX *ctx, const unsigned char *p, size_t len);
+extern int	vb_finish (VB_CTX *ctx);
+extern int	vb_close (VB_CTX *ctx);
+extern const char *	vb_strerror (int err);
+
+extern int	vb_fileattr (VB_FILE *fp, const unsigned char *rec, size_t len);
+extern void	vb_convstart (VB_CONV *cp, const VB_FILE *fp, int binary);
+extern int	vb_convert (VB_CONV *cp, const unsigned char *p, size_t len, VB_OUTFN out, void *arg);
+
+#endif
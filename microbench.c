@@ -0,0 +1,658 @@
+/*
+ *
+ *  Title:
+ *	Microbenchmarks
+ *
+ *  Description:
+ *	Times the inner loops of the decoder one at a time, on data made up
+ *	in memory, with no saveset and no files:
+ *
+ *		microbench [-s samples] [-m ms] [-n names] [-p patterns]
+ *			[benchmark ...]
+ *
+ *	  vbn-fix ... vbn-stmcr	 process_vbn ()'s conversion, vb_convert (),
+ *				 of 4 MB of a file in 31744 byte VBN records,
+ *				 into a buffer as out_conv () does with the
+ *				 output mapped (sparse VBNs found, not
+ *				 copied); vbn-var-b and vbn-vfc-b with -B
+ *	  fileattr		 the item loop of process_file (), vb_fileattr ()
+ *	  process_file		 process_file () itself, listing and
+ *				 extracting nothing: items, dates, selection
+ *	  strlocase		 strlocase () of a copy of a saveset name
+ *	  match			 match () of a name against each of the
+ *				 patterns in turn, until one matches
+ *	  selected		 selected () with the same patterns
+ *				 compiled by sel_init ()
+ *	  scan			 scan_bbh () resynchronizing over 4 MB with
+ *				 no block header in it
+ *
+ *	A benchmark named runs all those whose names start with it ("vbn"
+ *	runs them all); with none, all run.  Each is run once to size a
+ *	sample that takes about MS (20) milliseconds, then SAMPLES (15)
+ *	times; the median, the fastest, and the spread between the first
+ *	and third quartiles (as a part of the median) are printed in ns a
+ *	byte or an item, one line a benchmark, so that two builds compare
+ *	line by line.  NAMES (10000) file names and PATTERNS (1000)
+ *	patterns are made up.
+ *
+ *	The scan benchmark sends scan_bbh ()'s progress messages to
+ *	/dev/null.
+ *
+ */
+
+#include	<unistd.h>
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<fcntl.h>
+#include	<time.h>
+
+#include	<sys/types.h>
+
+#include	"fabdef.h"
+#include	"vmsbackup.h"
+#include	"libvmsbackup.h"
+
+int match ();
+char *strlocase ();
+
+#define	MB_DATASZ	(4 * 1024 * 1024)
+#define	MB_VBNSZ	(62 * 512)
+#define	MB_MAXSAMPLES	1000
+
+/* 2-JUN-2010 13:55:46.69.  */
+#define	MB_DATE		0x00a9e5e3c3a6c000ULL
+
+static int	mb_samples = 15, mb_ms = 20, mb_nnames = 10000, mb_npats = 1000;
+
+static unsigned long long	mb_seed = 1;
+
+/* A file's data and what it converts into.  */
+static unsigned char	*mb_data, *mb_out;
+static size_t	mb_datalen, mb_outpos;
+static VB_FILE	mb_file;
+static int	mb_binary;
+
+/* File header records, saveset names (upper case, as in the saveset)
+   and patterns.  */
+static unsigned char	**mb_recs;
+static size_t	*mb_reclens;
+static char	**mb_names, **mb_lnames, **mb_pats;
+
+static unsigned char	*mb_scanbuf;
+static size_t	mb_scanlen;
+
+/*
+ *  The time for vb_fileattr (); vmsbackup has it in getoptmain.c.
+ */
+int	time_vms_to_asc	(
+		short *	asclength,
+		char *	ascbuffer,
+		void	*srctime
+			)
+{
+	*asclength = vt_asc (srctime, ascbuffer);
+	return *asclength ? 1 : 0;
+}
+
+static unsigned	mb_rand	(void)
+{
+	mb_seed ^= mb_seed >> 12;
+	mb_seed ^= mb_seed << 25;
+	mb_seed ^= mb_seed >> 27;
+
+	return	(mb_seed * 2685821657736338717ULL) >> 32;
+}
+
+static void *	mb_alloc	(
+		size_t	n
+			)
+{
+void	*p;
+
+	if ( !(p = calloc (1, n)) )
+		{
+		fprintf (stderr, "microbench: out of memory\n");
+		exit (1);
+		}
+
+	return	p;
+}
+
+static void	mb_w	(
+		unsigned char *	p,
+		unsigned	v
+			)
+{
+	p [0] = v;
+	p [1] = v >> 8;
+}
+
+static double	mb_now	(void)
+{
+struct timespec	ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return	ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ *  Where vb_convert () puts the data: the output buffer, as out_data (),
+ *  out_putc () and out_write () put it into a mapped file.
+ */
+static int	mb_sink	(
+		void *			arg,
+		const unsigned char *	p,
+		size_t			n,
+		int			span
+			)
+{
+size_t	i, k;
+
+	if ( mb_outpos + n > 2 * MB_DATASZ )
+		mb_outpos = 0;
+
+	if ( !span )
+		{
+		if ( n == 1 )
+			mb_out [mb_outpos] = *p;
+		else	memcpy (mb_out + mb_outpos, p, n);
+
+		mb_outpos += n;
+		return	0;
+		}
+
+	for (i = 0; i < n; i += k)
+		{
+		k = n - i < 512 ? n - i : 512;
+
+		if ( !is_zero ((unsigned char *) p + i, k) )
+			memcpy (mb_out + mb_outpos + i, p + i, k);
+		}
+
+	mb_outpos += n;
+	return	0;
+}
+
+/*
+ *  About MB_DATASZ bytes of a file of format RECFMT (with attributes
+ *  RECATT): random bytes with every fourth VBN zero for FIX, lines of
+ *  text for the others.
+ */
+static void	mb_mkdata	(
+		int	recfmt,
+		int	recatt
+			)
+{
+static const char	words [] = "the quick brown fox jumps over the lazy dog ";
+size_t	n = 0, i;
+unsigned	len, k, vfc = recfmt == FAB$C_VFC ? 2 : 0;
+
+	if ( !mb_data )
+		{
+		mb_data = mb_alloc (MB_DATASZ + 1024);
+		mb_out = mb_alloc (2 * MB_DATASZ);
+		}
+
+	memset (mb_data, 0, MB_DATASZ + 1024);
+
+	if ( recfmt == FAB$C_FIX )
+		for (n = 0; n < MB_DATASZ; n++)
+			mb_data [n] = (n / 512) % 4 == 3 ? 0 : mb_rand ();
+
+	while ( n < MB_DATASZ - 512 )
+		{
+		len = mb_rand () % 133;
+
+		if ( recfmt == FAB$C_VAR || recfmt == FAB$C_VFC )
+			{
+			mb_w (mb_data + n, len + vfc);
+			n += 2;
+
+			for (k = 0; k < vfc; k++)
+				mb_data [n++] = k ? 0x8d : 0x01;
+			}
+
+		for (k = 0; k < len; k++)
+			mb_data [n++] = words [(len + k) % (sizeof (words) - 1)];
+
+		if ( recfmt == FAB$C_VAR || recfmt == FAB$C_VFC )
+			{
+			if ( n & 1 )
+				mb_data [n++] = 0;
+			}
+		else if ( recfmt == FAB$C_STMCR )
+			mb_data [n++] = '\r';
+		else	{
+			if ( recfmt == FAB$C_STM )
+				mb_data [n++] = '\r';
+
+			mb_data [n++] = '\n';
+			}
+		}
+
+	memset (&mb_file, 0, sizeof (mb_file));
+	mb_file.recfmt = recfmt;
+	mb_file.recatt = recatt;
+	mb_file.vfcsize = 2;
+	mb_file.size = n;
+	mb_datalen = (n + 511) / 512 * 512;
+
+	for (i = n; i < mb_datalen; i++)
+		mb_data [i] = 0;
+}
+
+static double	mb_vbn	(void)
+{
+VB_CONV	conv;
+size_t	off, n;
+
+	vb_convstart (&conv, &mb_file, mb_binary);
+	mb_outpos = 0;
+
+	for (off = 0; off < mb_datalen; off += n)
+		{
+		n = mb_datalen - off < MB_VBNSZ ? mb_datalen - off : MB_VBNSZ;
+		vb_convert (&conv, mb_data + off, n, mb_sink, NULL);
+		}
+
+	return	mb_datalen;
+}
+
+static void	mb_vbnfix (void) { mb_mkdata (FAB$C_FIX, 0); mb_binary = 0; }
+static void	mb_vbnvar (void) { mb_mkdata (FAB$C_VAR, FAB$M_CR); mb_binary = 0; }
+static void	mb_vbnvarb (void) { mb_mkdata (FAB$C_VAR, FAB$M_CR); mb_binary = 1; }
+static void	mb_vbnvfc (void) { mb_mkdata (FAB$C_VFC, FAB$M_PRN); mb_binary = 0; }
+static void	mb_vbnvfcb (void) { mb_mkdata (FAB$C_VFC, FAB$M_PRN); mb_binary = 1; }
+static void	mb_vbnstm (void) { mb_mkdata (FAB$C_STM, FAB$M_CR); mb_binary = 0; }
+static void	mb_vbnstmlf (void) { mb_mkdata (FAB$C_STMLF, FAB$M_CR); mb_binary = 0; }
+static void	mb_vbnstmcr (void) { mb_mkdata (FAB$C_STMCR, FAB$M_CR); mb_binary = 0; }
+
+/*
+ *  Add the item CODE of LEN bytes at P to the record at REC, *LENP bytes
+ *  long so far.
+ */
+static void	mb_item	(
+		unsigned char *	rec,
+		size_t *	lenp,
+		int		code,
+		const void *	p,
+		unsigned	len
+			)
+{
+	mb_w (rec + *lenp, len);
+	mb_w (rec + *lenp + 2, code);
+	memcpy (rec + *lenp + 4, p, len);
+	*lenp += 4 + len;
+}
+
+static const char	*mb_types [] = { "dat", "txt", "lis", "log", "com", "for", "c", "h" };
+
+/*
+ *  The names, and file header records for them as BACKUP writes them.
+ */
+static void	mb_mknames	(void)
+{
+unsigned char	rec [512], fat [32], v [8];
+unsigned long long	t;
+size_t	len;
+int	i, k;
+char	name [64], *p;
+
+	if ( mb_names )
+		return;
+
+	mb_names = mb_alloc (mb_nnames * sizeof (char *));
+	mb_lnames = mb_alloc (mb_nnames * sizeof (char *));
+	mb_recs = mb_alloc (mb_nnames * sizeof (unsigned char *));
+	mb_reclens = mb_alloc (mb_nnames * sizeof (size_t));
+
+	for (i = 0; i < mb_nnames; i++)
+		{
+		sprintf (name, "[BENCH.D%02u.SUB%u]F%06u.%s;%u", mb_rand () % 64, mb_rand () % 4,
+			mb_rand () % 1000000, mb_types [mb_rand () % 8], 1 + mb_rand () % 3);
+
+		for (p = name; *p; p++)
+			if ( *p >= 'a' && *p <= 'z' )
+				*p += 'A' - 'a';
+
+		mb_names [i] = strdup (name);
+		p = strrchr (name, ']') + 1;
+		*strchr (p, ';') = '\0';
+		mb_lnames [i] = strlocase (strdup (p));
+
+		memset (fat, 0, sizeof (fat));
+		k = mb_rand () % 4;
+		fat [0] = k == 0 ? FAB$C_FIX : k == 1 ? FAB$C_VAR : k == 2 ? FAB$C_VFC : FAB$C_STMLF;
+		fat [1] = k ? FAB$M_CR : 0;
+		mb_w (fat + 2, k ? 0 : 512);
+		mb_w (fat + 6, 1 + mb_rand () % 1000);
+		mb_w (fat + 10, 1 + mb_rand () % 1000);
+		mb_w (fat + 12, mb_rand () % 512);
+		fat [15] = 2;
+
+		len = 2;
+		rec [0] = rec [1] = 1;
+		mb_item (rec, &len, 0x2a, mb_names [i], strlen (mb_names [i]));
+		mb_w (v, i);
+		mb_w (v + 2, 1);
+		mb_w (v + 4, 0);
+		mb_item (rec, &len, 0x2c, v, 6);
+		mb_w (v, 4);
+		mb_w (v + 2, 0200);
+		mb_item (rec, &len, 0x2f, v, 4);
+		mb_w (v, 0xee44);
+		mb_item (rec, &len, 0x30, v, 2);
+		mb_item (rec, &len, 0x34, fat, sizeof (fat));
+		mb_w (v, 1);
+		mb_item (rec, &len, 0x35, v, 2);
+
+		/* Dates within a few weeks of each other.  */
+		for (k = 0x36; k <= 0x39; k++)
+			{
+			t = k == 0x38 ? 0 : MB_DATE + (unsigned long long) (mb_rand () % 3000000) * 10000000;
+			mb_w (v, t);
+			mb_w (v + 2, t >> 16);
+			mb_w (v + 4, t >> 32);
+			mb_w (v + 6, t >> 48);
+			mb_item (rec, &len, k, v, 8);
+			}
+
+		mb_item (rec, &len, 0, NULL, 0);
+
+		mb_recs [i] = mb_alloc (len);
+		memcpy (mb_recs [i], rec, len);
+		mb_reclens [i] = len;
+		}
+}
+
+/*
+ *  Patterns of each kind selected () sorts them into: names, prefixes,
+ *  and wildcards elsewhere.
+ */
+static void	mb_mkpats	(void)
+{
+char	pat [64];
+int	i;
+
+	mb_mknames ();
+
+	if ( mb_pats )
+		return;
+
+	mb_pats = mb_alloc ((mb_npats + 1) * sizeof (char *));
+
+	for (i = 0; i < mb_npats; i++)
+		{
+		switch (i % 4)
+			{
+			case 0: sprintf (pat, "f%06u.%s", mb_rand () % 1000000, mb_types [mb_rand () % 8]); break;
+			case 1: sprintf (pat, "f%04u*", mb_rand () % 10000); break;
+			case 2: sprintf (pat, "f%03u?%u.*", mb_rand () % 1000, mb_rand () % 10); break;
+			case 3: sprintf (pat, "*%03u[%u-9]*.%s", mb_rand () % 1000, mb_rand () % 10, mb_types [mb_rand () % 8]); break;
+			}
+
+		mb_pats [i] = strdup (pat);
+		}
+}
+
+static double	mb_fileattr	(void)
+{
+VB_FILE	fa;
+int	i;
+
+	for (i = 0; i < mb_nnames; i++)
+		vb_fileattr (&fa, mb_recs [i], mb_reclens [i]);
+
+	return	mb_nnames;
+}
+
+static double	mb_procfile	(void)
+{
+int	i;
+
+	for (i = 0; i < mb_nnames; i++)
+		process_file (mb_recs [i], mb_reclens [i]);
+
+	return	mb_nnames;
+}
+
+static double	mb_strlocase	(void)
+{
+char	tmp [64];
+int	i;
+
+	for (i = 0; i < mb_nnames; i++)
+		{
+		strcpy (tmp, mb_names [i]);
+		strlocase (tmp);
+		}
+
+	return	mb_nnames;
+}
+
+static double	mb_match	(void)
+{
+int	i, k;
+
+	for (i = 0; i < mb_nnames; i++)
+		for (k = 0; k < mb_npats && !match (mb_lnames [i], mb_pats [k]); k++)
+			;
+
+	return	mb_nnames;
+}
+
+static void	mb_selinit	(void)
+{
+	mb_mkpats ();
+
+	gargv = mb_pats;
+	goptind = 0;
+	gargc = mb_npats;
+	sel_init ();
+}
+
+static double	mb_selected	(void)
+{
+int	i;
+
+	for (i = 0; i < mb_nnames; i++)
+		selected ((unsigned char *) mb_names [i]);
+
+	return	mb_nnames;
+}
+
+/*
+ *  MB_DATASZ bytes of anything but a block header, then one.
+ */
+static void	mb_mkscan	(void)
+{
+unsigned char	*bbh;
+size_t	i;
+
+	mb_scanlen = MB_DATASZ + 256;
+	mb_scanbuf = mb_alloc (mb_scanlen);
+
+	for (i = 0; i < MB_DATASZ; i++)
+		mb_scanbuf [i] = mb_rand ();
+
+	for (i = 0; i < MB_DATASZ; i += 256)
+		mb_scanbuf [i + 1] = 0xff;
+
+	/* w_size, w_applic and l_blocksize; the names are empty.  */
+	bbh = mb_scanbuf + MB_DATASZ;
+	mb_w (bbh, 256);
+	mb_w (bbh + 6, 1);
+	mb_w (bbh + 40, blocksize);
+	mb_w (bbh + 42, blocksize >> 16);
+
+	memset (&input, 0, sizeof (input));
+	input.ondisk = 1;
+	input.map = mb_scanbuf;
+	input.mapsz = mb_scanlen;
+}
+
+static double	mb_scan	(void)
+{
+	input.pos = 0;
+	scan_bbh ();
+
+	return	MB_DATASZ;
+}
+
+static const struct {
+	const char *	name;
+	const char *	unit;
+	void		(*setup) (void);
+	double		(*run) (void);
+	} mb_benches [] = {
+	{ "vbn-fix", "byte", mb_vbnfix, mb_vbn },
+	{ "vbn-var", "byte", mb_vbnvar, mb_vbn },
+	{ "vbn-var-b", "byte", mb_vbnvarb, mb_vbn },
+	{ "vbn-vfc", "byte", mb_vbnvfc, mb_vbn },
+	{ "vbn-vfc-b", "byte", mb_vbnvfcb, mb_vbn },
+	{ "vbn-stm", "byte", mb_vbnstm, mb_vbn },
+	{ "vbn-stmlf", "byte", mb_vbnstmlf, mb_vbn },
+	{ "vbn-stmcr", "byte", mb_vbnstmcr, mb_vbn },
+	{ "fileattr", "record", mb_mknames, mb_fileattr },
+	/* Before selected (), which gives it patterns.  */
+	{ "process_file", "record", mb_mknames, mb_procfile },
+	{ "strlocase", "name", mb_mknames, mb_strlocase },
+	{ "match", "name", mb_mkpats, mb_match },
+	{ "selected", "name", mb_selinit, mb_selected },
+	{ "scan", "byte", mb_mkscan, mb_scan }
+	};
+
+#define	MB_NBENCH	(sizeof (mb_benches) / sizeof (mb_benches [0]))
+
+static int	mb_cmp	(
+		const void *	a,
+		const void *	b
+			)
+{
+double	x = *(const double *) a, y = *(const double *) b;
+
+	return	x < y ? -1 : x > y;
+}
+
+/*
+ *  Run benchmark B and print its line.
+ */
+static void	mb_bench	(
+		int	b
+			)
+{
+double	t, units, ns [MB_MAXSAMPLES];
+long	iters = 1, i;
+int	s, null = -1, out = -1;
+
+	mb_benches [b].setup ();
+
+	if ( mb_benches [b].run == mb_scan )
+		{
+		fflush (stdout);
+		out = dup (1);
+		null = open ("/dev/null", O_WRONLY);
+		dup2 (null, 1);
+		}
+
+	/* Enough passes for a sample to take MB_MS milliseconds.  */
+	for ( ; ; iters *= 2)
+		{
+		t = mb_now ();
+
+		for (i = 0; i < iters; i++)
+			mb_benches [b].run ();
+
+		if ( (t = mb_now () - t) >= mb_ms * 1e6 || iters > (1L << 30) )
+			break;
+		}
+
+	for (s = 0; s < mb_samples; s++)
+		{
+		units = 0;
+		t = mb_now ();
+
+		for (i = 0; i < iters; i++)
+			units += mb_benches [b].run ();
+
+		ns [s] = (mb_now () - t) / units;
+		}
+
+	if ( out >= 0 )
+		{
+		fflush (stdout);
+		dup2 (out, 1);
+		close (out);
+		close (null);
+		}
+
+	qsort (ns, mb_samples, sizeof (double), mb_cmp);
+
+	printf ("%-14s %10.3f %10.3f %7.1f%%  ns/%s\n", mb_benches [b].name,
+		ns [mb_samples / 2], ns [0],
+		100 * (ns [mb_samples * 3 / 4] - ns [mb_samples / 4]) / ns [mb_samples / 2],
+		mb_benches [b].unit);
+	fflush (stdout);
+}
+
+static void	mb_usage	(void)
+{
+unsigned	b;
+
+	fprintf (stderr, "Usage: microbench [-s samples] [-m ms] [-n names] [-p patterns] [benchmark ...]\nBenchmarks:");
+
+	for (b = 0; b < MB_NBENCH; b++)
+		fprintf (stderr, " %s", mb_benches [b].name);
+
+	fprintf (stderr, "\n");
+	exit (1);
+}
+
+int	main	(
+		int	argc,
+		char *	argv []
+			)
+{
+unsigned	b;
+int	c, i;
+
+	while ( (c = getopt (argc, argv, "s:m:n:p:")) != -1 )
+		switch (c)
+			{
+			case 's': mb_samples = atoi (optarg); break;
+			case 'm': mb_ms = atoi (optarg); break;
+			case 'n': mb_nnames = atoi (optarg); break;
+			case 'p': mb_npats = atoi (optarg); break;
+			default: mb_usage ();
+			}
+
+	if ( mb_samples < 1 || mb_samples > MB_MAXSAMPLES || mb_ms < 1 || mb_nnames < 1 || mb_npats < 1 )
+		mb_usage ();
+
+	for (i = optind; i < argc; i++)
+		{
+		for (b = 0; b < MB_NBENCH && strncmp (argv [i], mb_benches [b].name, strlen (argv [i])); b++)
+			;
+
+		if ( b == MB_NBENCH )
+			mb_usage ();
+		}
+
+	vb_init ();
+
+	printf ("%-14s %10s %10s %8s  (%d samples, %d names, %d patterns)\n",
+		"benchmark", "median", "fastest", "IQR", mb_samples, mb_nnames, mb_npats);
+
+	for (b = 0; b < MB_NBENCH; b++)
+		{
+		for (i = optind; i < argc && strncmp (argv [i], mb_benches [b].name, strlen (argv [i])); i++)
+			;
+
+		if ( optind == argc || i < argc )
+			mb_bench (b);
+		}
+
+	return	0;
+}
@@ -0,0 +1,600 @@
+/*
+ *
+ *  Title:
+ *	Saveset generator
+ *
+ *  Description:
+ *	Writes a synthetic but valid saveset, for "make bench" (bench.sh)
+ *	and for trying vmsbackup out on savesets of any shape without a
+ *	VMS system:
+ *
+ *		mksaveset [-b blocksize] [-g groupsize] [-n files]
+ *			[-s bytes] [-f formats] [-S seed] [-N] [-t] saveset
+ *
+ *	The saveset has a summary record, then for each file a file
+ *	record and its data in VBN records, packed into blocks of
+ *	BLOCKSIZE (32256 by default) with their header checksums and CRCs
+ *	(none with -N).  With -g every GROUPSIZE blocks are followed by
+ *	their XOR block, as BACKUP/GROUP_SIZE writes them.  With -t the
+ *	saveset is framed as on tape (VOL1, HDR1 and HDR2 labels, tape
+ *	marks and EOF labels) in a SIMH tape image, which vmsbackup reads
+ *	as a tape when its name ends in .tap.
+ *
+ *	The files are spread over a few directories, take their record
+ *	formats in turn from FORMATS (FIX, VAR, VFC, STM, STMLF and STMCR;
+ *	FIX, VAR, VFC and STMLF by default) and are 1 to twice BYTES
+ *	(4096) bytes long.  FIX files hold random bytes with every fourth
+ *	VBN zero; the others lines of text.  The contents come from SEED,
+ *	so the same arguments always give the same saveset.
+ *
+ *	The number of files, bytes of data and blocks written are printed
+ *	on the standard output.
+ *
+ */
+
+#include	<unistd.h>
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+
+#include	<sys/types.h>
+
+#include	"fabdef.h"
+#include	"vmsbackup.h"
+
+#define	MK_BBH_SZ	256
+#define	MK_BRH_SZ	16
+
+/* Record types.  */
+#define	MK_K_NULL	0
+#define	MK_K_SUMMARY	1
+#define	MK_K_FILE	3
+#define	MK_K_VBN	4
+
+/* Record formats we make.  */
+#define	MK_NFMTS	6
+
+/* 2-JUN-2010 13:55:46.69, for every date.  */
+#define	MK_DATE		0x00a9e5e3c3a6c000ULL
+
+static FILE	*mk_out;
+static int	mk_tape, mk_nocrc;
+static unsigned	mk_bsize = 32256, mk_group;
+
+/* The block being filled, how much of it is, its number, and the name
+   of the file whose data it holds (t_filename).  */
+static unsigned char	*mk_blk;
+static unsigned	mk_used, mk_number = 1;
+static char	mk_fname [128];
+
+/* The XOR of the blocks of the group so far, and how many there are.  */
+static unsigned char	*mk_xor;
+static unsigned	mk_ingroup;
+
+static unsigned long	mk_nblocks;
+static unsigned long long	mk_seed = 1;
+
+static void	mk_w	(
+		unsigned char *	p,
+		unsigned	v
+			)
+{
+	p [0] = v;
+	p [1] = v >> 8;
+}
+
+static void	mk_l	(
+		unsigned char *	p,
+		unsigned	v
+			)
+{
+	mk_w (p, v);
+	mk_w (p + 2, v >> 16);
+}
+
+/*
+ *  The next pseudo-random number (xorshift64*).
+ */
+static unsigned	mk_rand	(void)
+{
+	mk_seed ^= mk_seed >> 12;
+	mk_seed ^= mk_seed << 25;
+	mk_seed ^= mk_seed >> 27;
+
+	return	(mk_seed * 2685821657736338717ULL) >> 32;
+}
+
+/*
+ *  Write LEN bytes at P, as a tape record with -t.
+ */
+static void	mk_put	(
+		const void *	p,
+		unsigned	len
+			)
+{
+unsigned char	n [4];
+
+	if ( mk_tape )
+		{
+		mk_l (n, len);
+		fwrite (n, 1, 4, mk_out);
+		}
+
+	fwrite (p, 1, len, mk_out);
+
+	if ( mk_tape )
+		{
+		if ( len & 1 )
+			putc (0, mk_out);
+
+		fwrite (n, 1, 4, mk_out);
+		}
+}
+
+/*
+ *  A tape mark, with -t.
+ */
+static void	mk_mark	(void)
+{
+	if ( mk_tape )
+		fwrite ("\0\0\0\0", 1, 4, mk_out);
+}
+
+/*
+ *  An 80 byte tape label, from TEXT padded with blanks.
+ */
+static void	mk_label	(
+		const char *	text
+			)
+{
+char	lab [81];
+
+	sprintf (lab, "%-80.80s", text);
+	mk_put (lab, 80);
+}
+
+/*
+ *  Make the header of the block at BLK: checksum, then CRC.
+ */
+static void	mk_seal	(
+		unsigned char *	blk
+			)
+{
+unsigned	sum, crc;
+int	i;
+
+	mk_l (blk + 36, 0);
+	mk_w (blk + 254, 0);
+
+	for (i = sum = 0; i < 254; i += 2)
+		sum += blk [i] | blk [i + 1] << 8;
+
+	mk_w (blk + 254, sum);
+
+	if ( !mk_nocrc )
+		{
+		crc = ~crc32_update (0xffffffff, blk, mk_bsize);
+		mk_l (blk + 36, crc ? crc : 1);
+		}
+}
+
+/*
+ *  Write out the block being filled, padded with a null record, and
+ *  after it the XOR block if it ends a group.
+ */
+static void	mk_flush	(void)
+{
+unsigned char	*h = mk_blk;
+unsigned	i, n = strlen (mk_fname);
+
+	if ( mk_used == MK_BBH_SZ )
+		return;
+
+	if ( mk_used < mk_bsize )
+		{
+		memset (mk_blk + mk_used, 0, mk_bsize - mk_used);
+		mk_w (mk_blk + mk_used, mk_bsize - mk_used - MK_BRH_SZ);
+		}
+
+	memset (h, 0, MK_BBH_SZ);
+	mk_w (h, MK_BBH_SZ);
+	mk_w (h + 2, 0x800);
+	mk_w (h + 4, 1);
+	mk_w (h + 6, 1);
+	mk_l (h + 8, mk_number++);
+	mk_w (h + 32, 1);
+	mk_w (h + 34, 1);
+	mk_l (h + 40, mk_bsize);
+	h [48] = 5;
+	memcpy (h + 49, "BENCH", 5);
+	h [92] = n;
+	memcpy (h + 93, mk_fname, n);
+
+	mk_seal (mk_blk);
+	mk_put (mk_blk, mk_bsize);
+	mk_nblocks++;
+	mk_used = MK_BBH_SZ;
+
+	if ( !mk_group )
+		return;
+
+	for (i = MK_BBH_SZ; i < mk_bsize; i++)
+		mk_xor [i] ^= mk_blk [i];
+
+	if ( ++mk_ingroup < mk_group )
+		return;
+
+	/* The header of the last block of the group, as an XOR block.  */
+	memcpy (mk_xor, mk_blk, MK_BBH_SZ);
+	mk_w (mk_xor + 6, 2);
+	mk_seal (mk_xor);
+	mk_put (mk_xor, mk_bsize);
+	mk_nblocks++;
+
+	memset (mk_xor, 0, mk_bsize);
+	mk_ingroup = 0;
+}
+
+/*
+ *  Add a record of type TYPE with LEN bytes at P (VBN its address).
+ */
+static void	mk_rec	(
+		int		type,
+		const void *	p,
+		unsigned	len,
+		unsigned	vbn
+			)
+{
+unsigned char	*r;
+
+	if ( mk_used + MK_BRH_SZ + len + MK_BRH_SZ > mk_bsize )
+		mk_flush ();
+
+	r = mk_blk + mk_used;
+	memset (r, 0, MK_BRH_SZ);
+	mk_w (r, len);
+	mk_w (r + 2, type);
+	mk_l (r + 8, vbn);
+	memcpy (r + MK_BRH_SZ, p, len);
+	mk_used += MK_BRH_SZ + len;
+}
+
+/*
+ *  Add the item CODE of LEN bytes at P to the record being made at REC,
+ *  *LENP bytes long so far.
+ */
+static void	mk_item	(
+		unsigned char *	rec,
+		unsigned *	lenp,
+		int		code,
+		const void *	p,
+		unsigned	len
+			)
+{
+	mk_w (rec + *lenp, len);
+	mk_w (rec + *lenp + 2, code);
+	memcpy (rec + *lenp + 4, p, len);
+	*lenp += 4 + len;
+}
+
+static void	mk_date	(
+		unsigned char *	p,
+		unsigned long long	t
+			)
+{
+	mk_l (p, t);
+	mk_l (p + 4, t >> 32);
+}
+
+static void	mk_summary	(
+		const char *	name
+			)
+{
+unsigned char	rec [512], v [8];
+unsigned	len = 2;
+
+	rec [0] = rec [1] = 1;
+	mk_item (rec, &len, 1, name, strlen (name));
+	mk_item (rec, &len, 2, "BACKUP [BENCH...]*.* BENCH.BCK/SAVE", 35);
+	mk_item (rec, &len, 4, "SYSTEM", 6);
+	mk_w (v, 1);
+	mk_w (v + 2, 1);
+	mk_item (rec, &len, 5, v, 4);
+	mk_date (v, MK_DATE);
+	mk_item (rec, &len, 6, v, 8);
+	mk_w (v, 0x800);
+	mk_item (rec, &len, 7, v, 2);
+	mk_l (v, mk_bsize);
+	mk_item (rec, &len, 13, v, 4);
+	mk_w (v, mk_group);
+	mk_item (rec, &len, 14, v, 2);
+	mk_w (v, 3);
+	mk_item (rec, &len, 15, v, 2);
+	mk_item (rec, &len, 0, NULL, 0);
+
+	mk_rec (MK_K_SUMMARY, rec, len, 0);
+}
+
+/*
+ *  The file record for NAME: RECFMT, RECATT, and NBYTES bytes.
+ */
+static void	mk_filerec	(
+		const char *	name,
+		int		recfmt,
+		int		recatt,
+		unsigned	recsize,
+		unsigned long	nbytes
+			)
+{
+unsigned char	rec [512], fat [32], v [8];
+unsigned	len = 2, nblk = nbytes / 512 + 1, ablk = (nbytes + 511) / 512;
+
+	memset (fat, 0, sizeof (fat));
+	fat [0] = recfmt;
+	fat [1] = recatt;
+	mk_w (fat + 2, recsize);
+	mk_w (fat + 4, ablk >> 16);
+	mk_w (fat + 6, ablk);
+	mk_w (fat + 8, nblk >> 16);
+	mk_w (fat + 10, nblk);
+	mk_w (fat + 12, nbytes % 512);
+	fat [15] = recfmt == FAB$C_VFC ? 2 : 0;
+
+	rec [0] = rec [1] = 1;
+	mk_item (rec, &len, 0x2a, name, strlen (name));
+	mk_w (v, mk_number & 0xffff);
+	mk_w (v + 2, 1);
+	mk_w (v + 4, 0);
+	mk_item (rec, &len, 0x2c, v, 6);
+	mk_w (v, 4);
+	mk_w (v + 2, 0200);
+	mk_item (rec, &len, 0x2f, v, 4);
+	mk_w (v, 0xee44);
+	mk_item (rec, &len, 0x30, v, 2);
+	mk_item (rec, &len, 0x34, fat, sizeof (fat));
+	mk_w (v, 1);
+	mk_item (rec, &len, 0x35, v, 2);
+	mk_date (v, MK_DATE);
+	mk_item (rec, &len, 0x36, v, 8);
+	mk_item (rec, &len, 0x37, v, 8);
+	mk_date (v, 0);
+	mk_item (rec, &len, 0x38, v, 8);
+	mk_date (v, MK_DATE);
+	mk_item (rec, &len, 0x39, v, 8);
+	mk_item (rec, &len, 0, NULL, 0);
+
+	mk_rec (MK_K_FILE, rec, len, 0);
+}
+
+/*
+ *  The data of a file of format RECFMT, about WANT bytes of it, into
+ *  BUF (which takes WANT plus 512).  Returns the number of bytes.
+ */
+static unsigned long	mk_data	(
+		unsigned char *	buf,
+		int		recfmt,
+		unsigned long	want
+			)
+{
+static const char	words [] = "the quick brown fox jumps over the lazy dog ";
+unsigned long	n = 0, i;
+unsigned	len, k, vfc = recfmt == FAB$C_VFC ? 2 : 0;
+
+	if ( recfmt == FAB$C_FIX )
+		{
+		for (i = 0; i < want; i += 4)
+			mk_l (buf + i, (i / 512) % 4 == 3 ? 0 : mk_rand ());
+
+		return	want;
+		}
+
+	while ( n < want )
+		{
+		len = mk_rand () % 133;
+
+		if ( recfmt == FAB$C_STM || recfmt == FAB$C_STMLF || recfmt == FAB$C_STMCR )
+			{
+			for (k = 0; k < len; k++)
+				buf [n++] = words [(len + k) % (sizeof (words) - 1)];
+
+			if ( recfmt != FAB$C_STMLF )
+				buf [n++] = '\r';
+
+			if ( recfmt != FAB$C_STMCR )
+				buf [n++] = '\n';
+
+			continue;
+			}
+
+		/* Variable length: a count, the VFC bytes, the record, and
+		   a pad byte to an even length.  */
+		mk_w (buf + n, len + vfc);
+		n += 2;
+
+		for (k = 0; k < vfc; k++)
+			buf [n++] = k ? 0x8d : 0x01;
+
+		for (k = 0; k < len; k++)
+			buf [n++] = words [(len + k) % (sizeof (words) - 1)];
+
+		if ( n & 1 )
+			buf [n++] = 0;
+		}
+
+	return	n;
+}
+
+/*
+ *  The LEN bytes of data at BUF, as VBN records filling the blocks.
+ */
+static void	mk_vbns	(
+		unsigned char *	buf,
+		unsigned long	len
+			)
+{
+unsigned long	off, n;
+unsigned	room;
+
+	/* Up to the next multiple of 512, zeros after the end.  */
+	memset (buf + len, 0, 512 - len % 512);
+	len = (len + 511) / 512 * 512;
+
+	for (off = 0; off < len; off += n)
+		{
+		if ( (room = mk_bsize - mk_used - 2 * MK_BRH_SZ) < 512 || mk_bsize < mk_used + 2 * MK_BRH_SZ )
+			{
+			mk_flush ();
+			room = mk_bsize - mk_used - 2 * MK_BRH_SZ;
+			}
+
+		n = room / 512 * 512;
+
+		if ( n > len - off )
+			n = len - off;
+
+		mk_rec (MK_K_VBN, buf + off, n, off / 512 + 1);
+		}
+}
+
+static void	mk_usage	(void)
+{
+	fprintf (stderr, "Usage: mksaveset [-b blocksize] [-g groupsize] [-n files] [-s bytes] [-f FIX,VAR,VFC,STM,STMLF,STMCR] [-S seed] [-N] [-t] saveset\n");
+	exit (1);
+}
+
+int	main	(
+		int	argc,
+		char *	argv []
+			)
+{
+static const struct {
+	const char *	name;
+	int		recfmt, recatt;
+	const char *	type;
+	} fmts [] = {
+	{ "FIX", FAB$C_FIX, 0, "DAT" },
+	{ "VAR", FAB$C_VAR, FAB$M_CR, "TXT" },
+	{ "VFC", FAB$C_VFC, FAB$M_PRN, "LIS" },
+	{ "STM", FAB$C_STM, FAB$M_CR, "DOC" },
+	{ "STMLF", FAB$C_STMLF, FAB$M_CR, "LOG" },
+	{ "STMCR", FAB$C_STMCR, FAB$M_CR, "MEM" }
+	};
+int	use [MK_NFMTS], nuse = 0, c, k;
+unsigned	nfiles = 100, i;
+unsigned long	avg = 4096, len, want, total = 0;
+unsigned char	*buf;
+char	*p, *name, *base, lab [81], fdef [] = "FIX,VAR,VFC,STMLF", *formats = fdef;
+
+	while ( (c = getopt (argc, argv, "b:g:n:s:f:S:Nt")) != -1 )
+		switch (c)
+			{
+			case 'b': mk_bsize = strtoul (optarg, NULL, 0); break;
+			case 'g': mk_group = strtoul (optarg, NULL, 0); break;
+			case 'n': nfiles = strtoul (optarg, NULL, 0); break;
+			case 's': avg = strtoul (optarg, NULL, 0); break;
+			case 'f': formats = optarg; break;
+			case 'S': mk_seed = strtoull (optarg, NULL, 0) | 1; break;
+			case 'N': mk_nocrc = 1; break;
+			case 't': mk_tape = 1; break;
+			default: mk_usage ();
+			}
+
+	if ( optind != argc - 1 || mk_bsize < 2048 || mk_bsize > 65024 || mk_bsize % 512 || !avg )
+		mk_usage ();
+
+	for (p = strtok (formats, ","); p; p = strtok (NULL, ","))
+		{
+		for (k = 0; k < MK_NFMTS && strcasecmp (p, fmts [k].name); k++)
+			;
+
+		if ( k == MK_NFMTS )
+			mk_usage ();
+
+		use [nuse++ % MK_NFMTS] = k;
+		}
+
+	if ( !nuse )
+		mk_usage ();
+
+	if ( nuse > MK_NFMTS )
+		nuse = MK_NFMTS;
+
+	name = argv [optind];
+	base = (base = strrchr (name, '/')) ? base + 1 : name;
+
+	if ( !(mk_out = fopen (name, "wb")) )
+		{
+		perror (name);
+		exit (1);
+		}
+
+	if ( !(mk_blk = malloc (mk_bsize)) || !(mk_xor = calloc (1, mk_bsize))
+		|| !(buf = malloc (2 * avg + 1024)) )
+		{
+		fprintf (stderr, "out of memory\n");
+		exit (1);
+		}
+
+	crc_init ();
+	setvbuf (mk_out, NULL, _IOFBF, 1024 * 1024);
+
+	if ( mk_tape )
+		{
+		mk_label ("VOL1BENCH");
+		sprintf (lab, "HDR1%-17.17sBENCH 00010001", "BENCH.BCK");
+		mk_label (lab);
+		sprintf (lab, "HDR2F%05u%05u", mk_bsize, mk_bsize);
+		mk_label (lab);
+		mk_mark ();
+		}
+
+	mk_used = MK_BBH_SZ;
+	mk_summary (mk_tape ? "BENCH.BCK" : base);
+
+	for (i = 0; i < nfiles; i++)
+		{
+		k = use [i % nuse];
+		sprintf (mk_fname, "[BENCH.D%02u]F%06u.%s;1", i % 16, i, fmts [k].type);
+
+		want = 1 + mk_rand () % (2 * avg);
+		len = mk_data (buf, fmts [k].recfmt, want);
+
+		mk_filerec (mk_fname, fmts [k].recfmt, fmts [k].recatt,
+			fmts [k].recfmt == FAB$C_FIX ? 512 : 0, len);
+		mk_vbns (buf, len);
+		total += len;
+		}
+
+	mk_flush ();
+
+	/* A group cut short still has its XOR block.  */
+	if ( mk_group && mk_ingroup )
+		{
+		memcpy (mk_xor, mk_blk, MK_BBH_SZ);
+		mk_w (mk_xor + 6, 2);
+		mk_seal (mk_xor);
+		mk_put (mk_xor, mk_bsize);
+		mk_nblocks++;
+		}
+
+	if ( mk_tape )
+		{
+		mk_mark ();
+		sprintf (lab, "EOF1%-17.17sBENCH 00010001", "BENCH.BCK");
+		mk_label (lab);
+		sprintf (lab, "EOF2F%05u%05u", mk_bsize, mk_bsize);
+		mk_label (lab);
+		mk_mark ();
+		mk_mark ();
+		}
+
+	if ( fclose (mk_out) )
+		{
+		perror (name);
+		exit (1);
+		}
+
+	printf ("%u files %lu bytes %lu blocks\n", nfiles, total, mk_nblocks);
+
+	return	0;
+}
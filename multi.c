@@ -0,0 +1,288 @@
+/*
+ *
+ *  Title:
+ *	Several savesets
+ *
+ *  Description:
+ *	-f may be given more than once, and its argument may be a
+ *	wildcard (expanded here, for when the shell did not): the savesets
+ *	are then listed --parallel at a time (by default as many as there
+ *	are processors), each in a process of its own since vmsbackup ()
+ *	keeps its state in globals and exit ()s when done.  They are
+ *	extracted one at a time, still in a process each: savesets often
+ *	have files of the same name, which would be truncated and written
+ *	by two processes at once.
+ *
+ *	The output of each goes to temporary files, copied out in the
+ *	order the savesets were given as they finish, each headed by the
+ *	name of its saveset; the number of files and blocks of each comes
+ *	back through shared memory for a grand total at the end.
+ *
+ */
+
+#ifdef HAVE_UNIXIO_H
+#include	<unixio.h>
+#else
+#include	<unistd.h>
+#endif
+
+#include	<stdio.h>
+#include	<errno.h>
+#include	<stdlib.h>
+#include	<string.h>
+
+#include	<sys/types.h>
+#ifndef	NO_FORK
+#include	<sys/mman.h>
+#include	<sys/wait.h>
+#include	<glob.h>
+#endif
+
+#include	"vmsbackup.h"
+
+/* The counts of a saveset, as left by ms_done ().  */
+typedef struct __ms_total {
+	unsigned	nfiles;
+	unsigned long	nblocks;
+	int		done;
+} MS_TOTAL;
+
+typedef struct __ms_set {
+	char *		name;
+	pid_t		pid;		/* 0: not started, -1: finished */
+	int		status;
+	FILE *		out;
+	FILE *		err;
+} MS_SET;
+
+static MS_SET	*ms_sets;
+static int	ms_nsets;
+
+/* Shared with the children, and which one this is.  */
+static MS_TOTAL	*ms_totals;
+static int	ms_slot = -1;
+
+static void	ms_addone	(
+		char *	name
+			)
+{
+	if ( !(ms_sets = realloc (ms_sets, (ms_nsets + 1) * sizeof (MS_SET))) )
+		{
+		fprintf (stderr, "out of memory\n");
+		exit (1);
+		}
+
+	memset (ms_sets + ms_nsets, 0, sizeof (MS_SET));
+	ms_sets [ms_nsets++].name = name;
+
+	if ( !tapefile )
+		tapefile = name;
+}
+
+/*
+ *  Add the saveset or savesets NAME (from -f) to those to read.
+ */
+void	ms_add	(
+		char *	name
+			)
+{
+#ifndef	NO_FORK
+glob_t	g;
+size_t	i;
+
+	if ( strpbrk (name, "*?[") && !glob (name, 0, NULL, &g) )
+		{
+		/* The names stay with us to the end.  */
+		for (i = 0; i < g.gl_pathc; i++)
+			ms_addone (g.gl_pathv [i]);
+
+		return;
+		}
+#endif
+
+	ms_addone (name);
+}
+
+/*
+ *  How many savesets are there to read?
+ */
+int	ms_count	(void)
+{
+	return	ms_nsets;
+}
+
+/*
+ *  Which of the savesets this process is reading, or -1 if it is the
+ *  only one.
+ */
+int	ms_index	(void)
+{
+	return	ms_slot;
+}
+
+/*
+ *  Called by vmsbackup () when done with its saveset, with its counts.
+ */
+void	ms_done	(
+		unsigned	nfiles,
+		unsigned long	nblocks
+			)
+{
+	if ( ms_slot < 0 )
+		return;
+
+	ms_totals [ms_slot].nfiles = nfiles;
+	ms_totals [ms_slot].nblocks = nblocks;
+	ms_totals [ms_slot].done = 1;
+
+	fflush (stdout);
+	fflush (stderr);
+}
+
+#ifndef	NO_FORK
+/*
+ *  Copy the temporary file FP to TO, and close it.
+ */
+static void	ms_copy	(
+		FILE *	fp,
+		FILE *	to
+			)
+{
+char	buf [8192];
+size_t	n;
+
+	rewind (fp);
+
+	while ( (n = fread (buf, 1, sizeof (buf), fp)) )
+		fwrite (buf, 1, n, to);
+
+	fclose (fp);
+}
+
+/*
+ *  Start the next saveset, N, in a child of its own.
+ */
+static void	ms_start	(
+		int	n
+			)
+{
+MS_SET	*sp = ms_sets + n;
+
+	if ( !(sp->out = tmpfile ()) || !(sp->err = tmpfile ()) )
+		{
+		perror ("tmpfile");
+		exit (1);
+		}
+
+	fflush (stdout);
+	fflush (stderr);
+
+	if ( 0 > (sp->pid = fork ()) )
+		{
+		perror ("fork");
+		exit (1);
+		}
+
+	if ( sp->pid )
+		return;
+
+	dup2 (fileno (sp->out), 1);
+	dup2 (fileno (sp->err), 2);
+
+	ms_slot = n;
+	tapefile = sp->name;
+	vmsbackup ();
+}
+#endif
+
+/*
+ *  Read all the savesets, --parallel at a time, and exit.
+ */
+void	ms_run	(void)
+{
+#ifndef	NO_FORK
+int	i, k, status, next = 0, running = 0, failed = 0;
+unsigned	nfiles = 0;
+unsigned long	nblocks = 0;
+pid_t	pid;
+
+	if ( catalog || wflag || flag_pax )
+		{
+		fprintf (stderr, "-C, -w and --pax need a single saveset\n");
+		exit (1);
+		}
+
+	if ( parallel < 1 && (parallel = sysconf (_SC_NPROCESSORS_ONLN)) < 1 )
+		parallel = 1;
+
+	/* Files of the same name in two savesets end up as the later
+	   one's, not as a mixture of both.  */
+	if ( xflag )
+		parallel = 1;
+
+	ms_totals = mmap (NULL, ms_nsets * sizeof (MS_TOTAL), PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+	if ( ms_totals == MAP_FAILED )
+		{
+		perror ("mmap");
+		exit (1);
+		}
+
+	for (i = 0; next < ms_nsets; )
+		{
+		/* Start as many as we may.  */
+		for ( ; i < ms_nsets && running < parallel; i++, running++)
+			ms_start (i);
+
+		while ( 0 > (pid = wait (&status)) && errno == EINTR )
+			;
+
+		if ( pid < 0 )
+			{
+			perror ("wait");
+			exit (1);
+			}
+
+		running--;
+
+		for (k = next; k < i; k++)
+			if ( ms_sets [k].pid == pid )
+				{
+				ms_sets [k].pid = -1;
+				ms_sets [k].status = status;
+				}
+
+		/* Copy out those done, in order.  */
+		for ( ; next < i && ms_sets [next].pid == -1; next++)
+			{
+			/* --format records name their saveset.  */
+			if ( !listfmt )
+				printf ("%s%s:\n", next ? "\n" : "", ms_sets [next].name);
+
+			fflush (stdout);
+			ms_copy (ms_sets [next].out, stdout);
+			fflush (stdout);
+			ms_copy (ms_sets [next].err, stderr);
+
+			if ( !WIFEXITED (ms_sets [next].status) || WEXITSTATUS (ms_sets [next].status)
+				|| !ms_totals [next].done )
+				{
+				fprintf (stderr, "%s: failed\n", ms_sets [next].name);
+				failed++;
+				}
+
+			nfiles += ms_totals [next].nfiles;
+			nblocks += ms_totals [next].nblocks;
+			}
+		}
+
+	if ( (vflag || tflag) && !listfmt )
+		printf ("\nGrand total of %u files, %lu blocks in %d savesets\n", nfiles, nblocks, ms_nsets);
+
+	exit (failed ? 1 : 0);
+#else
+	fprintf (stderr, "Only one saveset at a time\n");
+	exit (1);
+#endif
+}
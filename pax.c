@@ -0,0 +1,488 @@
+/*
+ *
+ *  Title:
+ *	pax output
+ *
+ *  Description:
+ *	With --pax the files extracted go, instead of to disc, into a POSIX
+ *	pax archive on the standard output, in one pass over the saveset;
+ *	everything vmsbackup would print on the standard output goes to the
+ *	standard error instead.
+ *
+ *	Each file is a ustar member preceded by a pax extended header,
+ *	with the revision date as its mtime (to 100 ns) and the RMS
+ *	attributes and the rest of the file header as VMS.* keywords, so
+ *	that nothing BACKUP kept is lost on the way.
+ *
+ *	The size goes in the header, before the data.  Files whose data is
+ *	written byte for byte (fixed length and stream files, and all
+ *	files with -B) are streamed with the size from their file header;
+ *	variable length and VFC records come out shorter than they were
+ *	stored, so those files are held, in memory up to PAX_MEM bytes and
+ *	in a temporary file beyond, until their length is known.
+ *
+ */
+
+#ifdef HAVE_UNIXIO_H
+#include	<unixio.h>
+#else
+#include	<unistd.h>
+#endif
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<time.h>
+
+#include	<sys/types.h>
+
+#include	"fabdef.h"
+#include	"vmsbackup.h"
+#include	"libvmsbackup.h"
+
+#define	PAX_BLK		512
+#define	PAX_MEM		(1024 * 1024)
+#define	PAX_MAXOCT	077777777777UL	/* the most an 11 digit field holds */
+
+#define	MIN(a, b)	((a) < (b) ? (a) : (b))
+
+/* Where the archive goes: what was the standard output.  */
+static FILE	*pax_out;
+
+static const unsigned char	pax_zeros [PAX_BLK];
+
+/* The member being written: its name and size as given in its header,
+   and the number of bytes written so far.  HOLD is set if the data is
+   being held (PAX_LEN bytes, in PAX_BUF and then PAX_TMP) until the
+   header can be written.  */
+static char	pax_name [256];
+static long	pax_size, pax_done;
+static int	pax_hold;
+static unsigned char	*pax_buf;
+static size_t	pax_len;
+static FILE	*pax_tmp;
+
+/* The header of the member being written, and its extended header.  */
+static unsigned char	pax_hdr [PAX_BLK];
+static char	*pax_ext;
+static size_t	pax_extlen, pax_extsize;
+
+static void	pax_fail	(void)
+{
+	perror ("writing the archive");
+	exit (1);
+}
+
+/*
+ *  Write LEN bytes at P to the archive.
+ */
+static void	pax_put	(
+		const void *	p,
+		size_t		len
+			)
+{
+	if ( len && fwrite (p, 1, len, pax_out) != len )
+		pax_fail ();
+}
+
+/*
+ *  Zeros to the end of the 512 byte block, after LEN bytes of a member.
+ */
+static void	pax_pad	(
+		unsigned long	len
+			)
+{
+	if ( len % PAX_BLK )
+		pax_put (pax_zeros, PAX_BLK - len % PAX_BLK);
+}
+
+/*
+ *  Start the archive, taking over the standard output.
+ */
+void	pax_start	(void)
+{
+int	fd;
+
+	fflush (stdout);
+
+	if ( 0 > (fd = dup (1)) || !(pax_out = fdopen (fd, "wb")) || 0 > dup2 (2, 1) )
+		{
+		perror ("standard output");
+		exit (1);
+		}
+
+	setvbuf (pax_out, NULL, _IOFBF, 64 * 1024);
+}
+
+/*
+ *  The VMS date Q as pax has dates, in seconds since the epoch with a
+ *  fraction, into BUF; its whole seconds are returned.
+ */
+static long long	pax_time	(
+		char *			buf,
+		const unsigned char *	q
+			)
+{
+struct timespec	ts;
+int	i;
+
+	if ( !vt_timespec (q, &ts) )
+		ts.tv_sec = ts.tv_nsec = 0;
+
+	i = sprintf (buf, "%lld", (long long) ts.tv_sec);
+
+	if ( ts.tv_nsec )
+		{
+		sprintf (buf + i, ".%07ld", (long) ts.tv_nsec / 100);
+
+		for (i = strlen (buf); buf [i - 1] == '0'; i--)
+			buf [i - 1] = '\0';
+		}
+
+	return	ts.tv_sec;
+}
+
+/*
+ *  Add the record KEY=VAL to the extended header.  Its length comes
+ *  first and counts itself.
+ */
+static void	pax_rec	(
+		const char *	key,
+		const char *	val
+			)
+{
+size_t	n = strlen (key) + strlen (val) + 3, k;
+char	num [24];
+
+	for (k = n + 1; k != n + sprintf (num, "%lu", (unsigned long) k); )
+		k = n + strlen (num);
+
+	if ( pax_extlen + k + 1 > pax_extsize
+		&& !(pax_ext = realloc (pax_ext, pax_extsize = 2 * (pax_extlen + k + 1) + 1024)) )
+		{
+		fprintf (stderr, "out of memory\n");
+		exit (1);
+		}
+
+	sprintf (pax_ext + pax_extlen, "%lu %s=%s\n", (unsigned long) k, key, val);
+	pax_extlen += k;
+}
+
+/*
+ *  Put the number N in octal in the LEN byte field at P.
+ */
+static void	pax_oct	(
+		unsigned char *	p,
+		int		len,
+		unsigned long	n
+			)
+{
+	sprintf ((char *) p, "%0*lo", len - 1, n);
+}
+
+/*
+ *  Fill in a ustar header in H of type TYPE for NAME, of SIZE bytes.
+ */
+static void	pax_ustar	(
+		unsigned char *	h,
+		int		type,
+		const char *	name,
+		unsigned long	size
+			)
+{
+unsigned	sum, i;
+
+	pax_oct (h + 124, 12, size);
+	h [156] = type;
+	strncpy ((char *) h, name, 100);
+	memcpy (h + 257, "ustar\0" "00", 8);
+
+	memset (h + 148, ' ', 8);
+
+	for (sum = i = 0; i < PAX_BLK; i++)
+		sum += h [i];
+
+	sprintf ((char *) h + 148, "%06o", sum);
+}
+
+/*
+ *  Write the header of the member being written, SIZE bytes long.  A
+ *  size too big for the ustar field (8 GiB and more) goes in a size
+ *  record, with 0 in the field.
+ */
+static void	pax_header	(
+		unsigned long	size
+			)
+{
+unsigned char	x [PAX_BLK];
+char	name [100], *p;
+
+	if ( size > PAX_MAXOCT )
+		{
+		sprintf (name, "%lu", size);
+		pax_rec ("size", name);
+		}
+
+	if ( pax_extlen )
+		{
+		p = strrchr (pax_name, '/');
+		sprintf (name, "PaxHeader/%.80s", p ? p + 1 : pax_name);
+
+		memset (x, 0, sizeof (x));
+		memcpy (x + 100, pax_hdr + 100, 36);
+		memcpy (x + 136, pax_hdr + 136, 12);
+		pax_ustar (x, 'x', name, pax_extlen);
+
+		pax_put (x, PAX_BLK);
+		pax_put (pax_ext, pax_extlen);
+		pax_pad (pax_extlen);
+		}
+
+	pax_ustar (pax_hdr, '0', pax_name, size > PAX_MAXOCT ? 0 : size);
+	pax_put (pax_hdr, PAX_BLK);
+}
+
+/*
+ *  A file, FP, is to go into the archive as NAME, with BINARY as -B.
+ */
+void	pax_file	(
+		const VB_FILE *	fp,
+		const char *	name,
+		int		binary
+			)
+{
+static const unsigned char	zero [8];
+const unsigned char	*mtime;
+char	buf [128];
+unsigned	mode = 0, prot = ~fp->protection;
+int	i;
+
+	pax_done = pax_len = pax_extlen = 0;
+	pax_size = fp->size > 0 ? fp->size : 0;
+	strncpy (pax_name, name, sizeof (pax_name) - 1);
+
+	switch (fp->recfmt)
+		{
+		case FAB$C_FIX:
+		case FAB$C_STM:
+		case FAB$C_STMLF:
+		case FAB$C_STMCR:
+			/* Stream_CR only has its CRs made LFs.  */
+			pax_hold = 0;
+			break;
+
+		case FAB$C_VAR:
+		case FAB$C_VFC:
+			pax_hold = !binary;
+			break;
+
+		default:
+			/* To be dropped: vb_convert () cannot take it.  */
+			pax_hold = 1;
+			break;
+		}
+
+	/* Owner, group and world; a bit set in the protection denies.  */
+	mode = (prot >> 4 & 1 ? 0400 : 0) | (prot >> 5 & 1 ? 0200 : 0) | (prot >> 6 & 1 ? 0100 : 0)
+		| (prot >> 8 & 1 ? 040 : 0) | (prot >> 9 & 1 ? 020 : 0) | (prot >> 10 & 1 ? 010 : 0)
+		| (prot >> 12 & 1 ? 04 : 0) | (prot >> 13 & 1 ? 02 : 0) | (prot >> 14 & 1 ? 01 : 0);
+
+	memset (pax_hdr, 0, sizeof (pax_hdr));
+	pax_oct (pax_hdr + 100, 8, mode);
+	pax_oct (pax_hdr + 108, 8, fp->uic_member);
+	pax_oct (pax_hdr + 116, 8, fp->uic_group);
+
+	mtime = memcmp (fp->revised, zero, 8) ? fp->revised : fp->created;
+
+	if ( memcmp (mtime, zero, 8) )
+		{
+		long long	s = pax_time (buf, mtime);
+
+		pax_oct (pax_hdr + 136, 12, s < 0 ? 0 : (unsigned long) s);
+		pax_rec ("mtime", buf);
+		}
+	else	pax_oct (pax_hdr + 136, 12, 0);
+
+	if ( strlen (pax_name) >= 100 )
+		pax_rec ("path", pax_name);
+
+	pax_rec ("VMS.name", fp->name);
+
+	sprintf (buf, "(%u,%u,%u)", fp->fid [0], fp->fid [1], fp->fid [2]);
+	pax_rec ("VMS.fid", buf);
+
+	sprintf (buf, "[%06o,%06o]", fp->uic_group, fp->uic_member);
+	pax_rec ("VMS.owner", buf);
+
+	sprintf (buf, "%04x", fp->protection);
+	pax_rec ("VMS.protection", buf);
+
+	sprintf (buf, "%u", fp->revision);
+	pax_rec ("VMS.revision", buf);
+
+	if ( fmt_rfm (fp->recfmt) )
+		strcpy (buf, fmt_rfm (fp->recfmt));
+	else	sprintf (buf, "%u", fp->recfmt & 0x0f);
+
+	pax_rec ("VMS.rfm", buf);
+	pax_rec ("VMS.org", fmt_org (fp->recfmt));
+	pax_rec ("VMS.rat", fmt_rat (buf, fp->recatt));
+
+	sprintf (buf, "%u", fp->recsize);
+	pax_rec ("VMS.mrs", buf);
+
+	if ( (fp->recfmt & 0x0f) == FAB$C_VFC )
+		{
+		sprintf (buf, "%u", fp->vfcsize);
+		pax_rec ("VMS.fsz", buf);
+		}
+
+	sprintf (buf, "%u", fp->ablk);
+	pax_rec ("VMS.alq", buf);
+
+	sprintf (buf, "%u", fp->extension);
+	pax_rec ("VMS.deq", buf);
+
+	sprintf (buf, "%u", fp->nblk);
+	pax_rec ("VMS.ebk", buf);
+
+	sprintf (buf, "%u", fp->lnch);
+	pax_rec ("VMS.ffb", buf);
+
+	sprintf (buf, "%ld", fp->size);
+	pax_rec ("VMS.size", buf);
+
+	for (i = 0; i < 4; i++)
+		{
+		const unsigned char	*q = i == 0 ? fp->created : i == 1 ? fp->revised
+						: i == 2 ? fp->expires : fp->backup;
+
+		if ( memcmp (q, zero, 8) )
+			{
+			pax_time (buf, q);
+			pax_rec (i == 0 ? "VMS.created" : i == 1 ? "VMS.revised"
+				: i == 2 ? "VMS.expires" : "VMS.backup", buf);
+			}
+		}
+
+	if ( !pax_hold )
+		pax_header (pax_size);
+}
+
+/*
+ *  N bytes at P of the data of the file.
+ */
+void	pax_write	(
+		const unsigned char *	p,
+		size_t			n
+			)
+{
+	if ( !pax_hold )
+		{
+		/* No more than the header said; vb_convert () sees to it.  */
+		if ( (long) n > pax_size - pax_done )
+			n = pax_size - pax_done;
+
+		pax_put (p, n);
+		pax_done += n;
+		return;
+		}
+
+	if ( !pax_tmp && pax_len + n <= PAX_MEM )
+		{
+		if ( !pax_buf && !(pax_buf = malloc (PAX_MEM)) )
+			{
+			fprintf (stderr, "out of memory\n");
+			exit (1);
+			}
+
+		memcpy (pax_buf + pax_len, p, n);
+		}
+	else	{
+		if ( !pax_tmp )
+			{
+			if ( !(pax_tmp = tmpfile ()) )
+				{
+				perror ("tmpfile");
+				exit (1);
+				}
+
+			fwrite (pax_buf, 1, pax_len, pax_tmp);
+			}
+
+		if ( fwrite (p, 1, n, pax_tmp) != n )
+			{
+			perror ("tmpfile");
+			exit (1);
+			}
+		}
+
+	pax_len += n;
+}
+
+/*
+ *  The file has been passed over after all.  Only a file being held can
+ *  be: see process_vbn ().
+ */
+void	pax_drop	(void)
+{
+	if ( pax_tmp )
+		fclose (pax_tmp);
+
+	pax_tmp = NULL;
+	pax_hold = 0;
+	pax_size = pax_done = 0;
+}
+
+/*
+ *  All of the file has been written.
+ */
+void	pax_close	(void)
+{
+unsigned char	buf [8192];
+size_t	n;
+
+	if ( pax_hold )
+		{
+		pax_header (pax_len);
+
+		if ( !pax_tmp )
+			pax_put (pax_buf, pax_len);
+		else	{
+			rewind (pax_tmp);
+
+			while ( (n = fread (buf, 1, sizeof (buf), pax_tmp)) )
+				pax_put (buf, n);
+
+			fclose (pax_tmp);
+			pax_tmp = NULL;
+			}
+
+		pax_pad (pax_len);
+		pax_hold = 0;
+		return;
+		}
+
+	if ( pax_done < pax_size )
+		{
+		fprintf (stderr, "%s: %ld bytes missing from the saveset, written as zeros\n",
+			pax_name, pax_size - pax_done);
+
+		for ( ; pax_done < pax_size; pax_done += n)
+			pax_put (pax_zeros, n = MIN (PAX_BLK, (size_t) (pax_size - pax_done)));
+		}
+
+	pax_pad (pax_size);
+}
+
+/*
+ *  The end of the archive: two blocks of zeros.
+ */
+void	pax_end	(void)
+{
+	pax_put (pax_zeros, PAX_BLK);
+	pax_put (pax_zeros, PAX_BLK);
+
+	if ( fflush (pax_out) || ferror (pax_out) )
+		pax_fail ();
+}
@@ -0,0 +1,873 @@
+/*
+ *
+ *  Title:
+ *	File selection
+ *
+ *  Description:
+ *	The names on the command line, and those in --include-from and
+ *	--exclude-from files, are patterns for match () (shell style: *, ?
+ *	and [...]) against the lower case name of each file in the saveset.
+ *	Rather than calling match () for every pattern and every file,
+ *	sel_init () sorts the patterns once:
+ *
+ *	  - names without wildcards go into a hash set;
+ *
+ *	  - names with just a * at the end go into a trie of prefixes;
+ *
+ *	  - other patterns are compiled into a bit-parallel automaton of up
+ *	    to 63 steps (one bit per step, a step being a character, a ?,
+ *	    a [...] or a *), which takes a name a character at a time;
+ *
+ *	  - the odd pattern which does not fit (a [...] with escapes, a
+ *	    very long one) is left to match ().
+ *
+ *	With --vms-match the names are VMS file specifications instead,
+ *	matched against the whole [DIR.SUB]NAME.TYPE;VER of each file:
+ *	* and % within each field and each directory, ... in the
+ *	directory for any number of levels, and ;0 (or ;), ;-n, ;n and ;*
+ *	for versions.  A missing directory is any, a missing type or
+ *	version all.  Relative versions count on BACKUP listing the
+ *	versions of a file together, highest first.  When no pattern can
+ *	match a file in a directory or below it, the directory is noted
+ *	and the rest of its subtree turned away without matching.
+ *
+ *	Unless -e is given, files of the types below are not extracted;
+ *	this is an exclude list of its own.
+ *
+ */
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+
+#include	<sys/types.h>
+
+#include	"vmsbackup.h"
+
+int match ();
+char *strlocase ();
+
+/* Types not extracted without -e.  */
+static char	*sel_types [] = {
+	"*.exe", "*.lib", "*.obj", "*.odl", "*.olb", "*.pmd", "*.stb",
+	"*.sys", "*.tsk", NULL
+	};
+
+#define	SEL_MAXSTEPS	63
+
+/* Most directory levels of a VMS name we look at.  */
+#define	SEL_MAXDEPTH	64
+
+/* Versions a VMS pattern takes.  */
+#define	SEL_K_ALLVER	0		/* ;* or none */
+#define	SEL_K_VER	1		/* ;n */
+#define	SEL_K_RELVER	2		/* ;0 or ;-n, as n */
+
+/* A node of the prefix trie: its first child and next sibling, as
+   indexes into the node array.  */
+typedef struct __sel_node {
+	int		child, next;
+	unsigned char	c;
+	char		end;		/* a prefix ends here */
+} SEL_NODE;
+
+/* A compiled pattern: bit i is step i, bit m (the number of steps)
+   is the end.  */
+typedef struct __sel_glob {
+	unsigned long long	chars [256];	/* steps a character gets past */
+	unsigned long long	star;		/* * steps */
+	int		m;
+} SEL_GLOB;
+
+/* A VMS file specification.  */
+typedef struct __sel_vms {
+	char **		dir;		/* levels, NULL for ... */
+	int		ndir;		/* -1: any directory */
+	char *		file;		/* name.type */
+	int		vermode, ver;
+} SEL_VMS;
+
+/* A file name taken apart for matching VMS patterns.  */
+typedef struct __sel_name {
+	char *		dir [SEL_MAXDEPTH];
+	int		ndir;
+	char *		file;
+	int		ver;
+	int		rank;		/* 0 for the highest version, ... */
+} SEL_NAME;
+
+typedef struct __sel_set {
+	int		n;		/* patterns, of all kinds */
+
+	char **		lit;		/* hash set of names */
+	unsigned	nlit, litsize;
+
+	SEL_NODE *	trie;		/* node 0 is the root */
+	int		ntrie, trieall;
+
+	SEL_GLOB *	glob;
+	int		nglob;
+
+	char **		slow;		/* for match () */
+	int		nslow;
+
+	SEL_VMS *	vms;
+	int		nvms;
+} SEL_SET;
+
+static SEL_SET	sel_incl, sel_excl, sel_xtypes;
+
+/* The last file seen, without its version, and its rank.  */
+static char	sel_lastfile [256];
+static int	sel_rank;
+
+/* A directory whose subtree no pattern matches, without its ].  */
+static char	sel_prune [256];
+static size_t	sel_prunelen;
+
+static void *	sel_grow	(
+		void *	p,
+		size_t	size
+			)
+{
+	if ( !(p = realloc (p, size)) )
+		{
+		fprintf (stderr, "out of memory\n");
+		exit (1);
+		}
+
+	return	p;
+}
+
+static unsigned	sel_hash	(
+		char *	p
+			)
+{
+unsigned	h = 2166136261u;
+
+	while ( *p )
+		h = (h ^ (unsigned char) *p++) * 16777619u;
+
+	return	h;
+}
+
+/*
+ *  The slot of NAME in the hash set of SP: where it is or would go.
+ */
+static char **	sel_slot	(
+		SEL_SET *	sp,
+		char *		name
+			)
+{
+unsigned	i;
+
+	for (i = sel_hash (name) & (sp->litsize - 1); sp->lit [i]; i = (i + 1) & (sp->litsize - 1))
+		if ( !strcmp (sp->lit [i], name) )
+			break;
+
+	return	sp->lit + i;
+}
+
+static void	sel_addlit	(
+		SEL_SET *	sp,
+		char *		name
+			)
+{
+char	**old = sp->lit, **pp;
+unsigned	i, n = sp->litsize;
+
+	/* Kept at most half full.  */
+	if ( 2 * (sp->nlit + 1) > sp->litsize )
+		{
+		sp->litsize = n ? 2 * n : 1024;
+		sp->lit = calloc (sp->litsize, sizeof (char *));
+
+		if ( !sp->lit )
+			{
+			fprintf (stderr, "out of memory\n");
+			exit (1);
+			}
+
+		for (i = 0; i < n; i++)
+			if ( old [i] )
+				*sel_slot (sp, old [i]) = old [i];
+
+		free (old);
+		}
+
+	if ( *(pp = sel_slot (sp, name)) )
+		free (name);
+	else	{
+		*pp = name;
+		sp->nlit++;
+		}
+}
+
+static void	sel_addprefix	(
+		SEL_SET *	sp,
+		char *		p
+			)
+{
+int	k, node = 0;
+
+	if ( !sp->ntrie )
+		{
+		sp->trie = sel_grow (NULL, sizeof (SEL_NODE));
+		memset (sp->trie, 0, sizeof (SEL_NODE));
+		sp->trie [0].child = -1;
+		sp->ntrie = 1;
+		}
+
+	for ( ; *p; p++)
+		{
+		for (k = sp->trie [node].child; k >= 0 && sp->trie [k].c != (unsigned char) *p; k = sp->trie [k].next)
+			;
+
+		if ( k < 0 )
+			{
+			sp->trie = sel_grow (sp->trie, (sp->ntrie + 1) * sizeof (SEL_NODE));
+			k = sp->ntrie++;
+			sp->trie [k].c = *p;
+			sp->trie [k].end = 0;
+			sp->trie [k].child = -1;
+			sp->trie [k].next = sp->trie [node].child;
+			sp->trie [node].child = k;
+			}
+
+		node = k;
+		}
+
+	sp->trie [node].end = 1;
+
+	if ( !node )
+		sp->trieall = 1;
+}
+
+/*
+ *  Compile the pattern P into G.  Returns -1 if it is not one we
+ *  compile, as match () would see it.
+ */
+static int	sel_compile	(
+		SEL_GLOB *	g,
+		char *		p
+			)
+{
+unsigned long long	bit;
+int	c, lo, hi, neg;
+
+	memset (g, 0, sizeof (SEL_GLOB));
+
+	for ( ; *p; p++)
+		{
+		/* Runs of * are one.  */
+		if ( *p == '*' && g->m && (g->star & 1ULL << (g->m - 1)) )
+			continue;
+
+		if ( g->m == SEL_MAXSTEPS )
+			return	-1;
+
+		bit = 1ULL << g->m++;
+
+		switch (*p)
+			{
+			case '*':
+				g->star |= bit;
+				break;
+
+			case '?':
+				for (c = 1; c < 256; c++)
+					g->chars [c] |= bit;
+				break;
+
+			case '[':
+				if ( (neg = *++p == '!') )
+					p++;
+
+				/* The characters of the class, compared as
+				   match () does (as plain chars).  */
+				while ( *p != ']' )
+					{
+					if ( !*p || *p == '\\' )
+						return	-1;
+
+					lo = hi = (char) *p++;
+
+					if ( *p == '-' )
+						{
+						if ( !p [1] || p [1] == ']' || p [1] == '\\' )
+							return	-1;
+
+						hi = (char) p [1];
+						p += 2;
+						}
+
+					for (c = 1; c < 256; c++)
+						if ( (char) c >= lo && (char) c <= hi )
+							g->chars [c] |= bit;
+					}
+
+				if ( neg )
+					for (c = 1; c < 256; c++)
+						g->chars [c] ^= bit;
+				break;
+
+			default:
+				g->chars [(unsigned char) *p] |= bit;
+				break;
+			}
+		}
+
+	return	0;
+}
+
+/*
+ *  Run NAME through the compiled pattern G.
+ */
+static int	sel_run	(
+		SEL_GLOB *	g,
+		unsigned char *	name
+			)
+{
+unsigned long long	d = 1;
+
+	d |= (d & g->star) << 1;
+
+	for ( ; *name && d; name++)
+		{
+		d = ((d & g->chars [*name]) << 1) | (d & g->star);
+		d |= (d & g->star) << 1;
+		}
+
+	return	(d >> g->m) & 1;
+}
+
+/*
+ *  Does the string S match the pattern P of a field of a VMS name, with *
+ *  and %?
+ */
+static int	sel_field	(
+		char *	s,
+		char *	p
+			)
+{
+char	*star = NULL, *back = NULL;
+
+	while ( *s )
+		if ( *p == '*' )
+			{
+			star = ++p;
+			back = s;
+			}
+		else if ( *p == '%' || *p == *s )
+			{
+			p++;
+			s++;
+			}
+		else if ( star )
+			{
+			p = star;
+			s = ++back;
+			}
+		else	return	0;
+
+	while ( *p == '*' )
+		p++;
+
+	return	!*p;
+}
+
+/*
+ *  Do the N levels of directory D match the NT levels of pattern T?  With
+ *  PART, could D be the top of a directory that does?
+ */
+static int	sel_dir	(
+		char **	t,
+		int	nt,
+		char **	d,
+		int	n,
+		int	part
+			)
+{
+	if ( !n )
+		{
+		if ( part )
+			return	1;
+
+		while ( nt && !*t )
+			t++, nt--;
+
+		return	!nt;
+		}
+
+	if ( !nt )
+		return	0;
+
+	if ( !*t )
+		return	sel_dir (t + 1, nt - 1, d, n, part) || sel_dir (t, nt, d + 1, n - 1, part);
+
+	return	sel_field (*d, *t) && sel_dir (t + 1, nt - 1, d + 1, n - 1, part);
+}
+
+static void	sel_badspec	(
+		char *	pat
+			)
+{
+	fprintf (stderr, "%s: bad file specification\n", pat);
+	exit (1);
+}
+
+/*
+ *  Compile the VMS file specification PAT (lower case, malloc ()ed) into
+ *  a new pattern of SP.
+ */
+static void	sel_addvms	(
+		SEL_SET *	sp,
+		char *		pat
+			)
+{
+SEL_VMS	*vp;
+char	*p, *q, *end, *file;
+size_t	n;
+
+	sp->vms = sel_grow (sp->vms, (sp->nvms + 1) * sizeof (SEL_VMS));
+	vp = sp->vms + sp->nvms++;
+	vp->dir = NULL;
+	vp->ndir = -1;
+
+	/* No device in saveset names.  */
+	if ( (p = strchr (pat, ':')) && p < pat + strcspn (pat, "[<") )
+		p++;
+	else	p = pat;
+
+	if ( *p == '[' || *p == '<' )
+		{
+		if ( !(end = strchr (p, *p == '[' ? ']' : '>')) )
+			sel_badspec (pat);
+
+		*end = '\0';
+		vp->dir = sel_grow (NULL, (end - p) * sizeof (char *));
+		vp->ndir = 0;
+
+		for (p++; *p; )
+			if ( !strncmp (p, "...", 3) )
+				{
+				vp->dir [vp->ndir++] = NULL;
+				p += 3;
+				}
+			else	{
+				n = strcspn (p, ".");
+				vp->dir [vp->ndir] = sel_grow (NULL, n + 1);
+				memcpy (vp->dir [vp->ndir], p, n);
+				vp->dir [vp->ndir++] [n] = '\0';
+
+				if ( *(p += n) == '.' && strncmp (p, "...", 3) )
+					p++;
+				}
+
+		/* [000000...] is the whole volume.  */
+		if ( vp->ndir > 1 && !vp->dir [1] && !strcmp (vp->dir [0], "000000") )
+			{
+			vp->dir++;
+			vp->ndir--;
+			}
+
+		p = end + 1;
+		}
+
+	/* The version.  */
+	vp->vermode = SEL_K_ALLVER;
+
+	if ( (q = strchr (p, ';')) )
+		{
+		*q++ = '\0';
+
+		if ( !*q || !strcmp (q, "0") )
+			{
+			vp->vermode = SEL_K_RELVER;
+			vp->ver = 0;
+			}
+		else if ( *q == '-' && q [1] && strspn (q + 1, "0123456789") == strlen (q + 1) )
+			{
+			vp->vermode = SEL_K_RELVER;
+			vp->ver = atoi (q + 1);
+			}
+		else if ( strspn (q, "0123456789") == strlen (q) )
+			{
+			vp->vermode = SEL_K_VER;
+			vp->ver = atoi (q);
+			}
+		else if ( strcmp (q, "*") )
+			sel_badspec (pat);
+		}
+
+	/* name.type, with * for what is missing.  */
+	if ( !(file = malloc (strlen (p) + 4)) )
+		{
+		fprintf (stderr, "out of memory\n");
+		exit (1);
+		}
+
+	sprintf (file, "%s%s%s", *p && *p != '.' ? "" : "*", p, strchr (p, '.') ? "" : ".*");
+	vp->file = file;
+
+	free (pat);
+}
+
+/*
+ *  Does the file NP match a VMS pattern of SP?
+ */
+static int	sel_vmsmatch	(
+		SEL_SET *	sp,
+		SEL_NAME *	np
+			)
+{
+SEL_VMS	*vp;
+int	i;
+
+	for (i = 0, vp = sp->vms; i < sp->nvms; i++, vp++)
+		{
+		if ( vp->vermode == SEL_K_VER && np->ver != vp->ver )
+			continue;
+
+		if ( vp->vermode == SEL_K_RELVER && np->rank != vp->ver )
+			continue;
+
+		if ( vp->ndir >= 0 && !sel_dir (vp->dir, vp->ndir, np->dir, np->ndir, 0) )
+			continue;
+
+		if ( sel_field (np->file, vp->file) )
+			return	1;
+		}
+
+	return	0;
+}
+
+/*
+ *  Could a VMS pattern of SP match some file in the directory of NP or
+ *  below it?
+ */
+static int	sel_vmstree	(
+		SEL_SET *	sp,
+		SEL_NAME *	np
+			)
+{
+int	i;
+
+	for (i = 0; i < sp->nvms; i++)
+		if ( sp->vms [i].ndir < 0 || sel_dir (sp->vms [i].dir, sp->vms [i].ndir, np->dir, np->ndir, 1) )
+			return	1;
+
+	return	0;
+}
+
+/*
+ *  Is FN selected, matching the patterns as VMS file specifications?
+ */
+static int	sel_vms	(
+		unsigned char *	fn
+			)
+{
+SEL_NAME	n;
+char	name [256], *p, *q;
+size_t	i, len;
+
+	for (i = 0; i < sizeof (name) - 1 && fn [i]; i++)
+		name [i] = fn [i] >= 'A' && fn [i] <= 'Z' ? fn [i] - 'A' + 'a' : fn [i];
+
+	name [i] = '\0';
+
+	/* A subtree already turned away?  */
+	if ( sel_prunelen && !strncmp (name, sel_prune, sel_prunelen)
+		&& (name [sel_prunelen] == ']' || name [sel_prunelen] == '.') )
+		return	0;
+
+	/* The rank of the version: the versions of a file come together. */
+	len = strcspn (name, ";");
+
+	if ( len == strlen (sel_lastfile) && !strncmp (name, sel_lastfile, len) )
+		sel_rank++;
+	else	{
+		memcpy (sel_lastfile, name, len);
+		sel_lastfile [len] = '\0';
+		sel_rank = 0;
+		}
+
+	n.rank = sel_rank;
+	n.ver = name [len] ? atoi (name + len + 1) : 0;
+	name [len] = '\0';
+
+	/* The directory levels.  */
+	n.ndir = 0;
+	n.file = name;
+
+	if ( *name == '[' && (q = strchr (name, ']')) )
+		{
+		*q = '\0';
+		n.file = q + 1;
+
+		for (p = name + 1; n.ndir < SEL_MAXDEPTH; p++)
+			{
+			n.dir [n.ndir++] = p;
+
+			if ( !(p = strchr (p, '.')) )
+				break;
+
+			*p = '\0';
+			}
+		}
+
+	if ( sel_incl.n && !sel_vmsmatch (&sel_incl, &n) )
+		{
+		if ( n.ndir && !sel_vmstree (&sel_incl, &n) )
+			{
+			/* Put the name back together up to the ]. */
+			for (sel_prunelen = 0, i = 0; i < n.ndir; i++)
+				sel_prunelen += sprintf (sel_prune + sel_prunelen, "%s%s", i ? "." : "[", n.dir [i]);
+			}
+
+		return	0;
+		}
+
+	return	!sel_excl.n || !sel_vmsmatch (&sel_excl, &n);
+}
+
+/*
+ *  Add the pattern PAT (lower case, malloc ()ed) to SP.
+ */
+static void	sel_add	(
+		SEL_SET *	sp,
+		char *		pat
+			)
+{
+char	*p, *meta;
+size_t	len;
+
+	sp->n++;
+
+	if ( flag_vmsmatch && sp != &sel_xtypes )
+		{
+		sel_addvms (sp, pat);
+		return;
+		}
+
+	meta = strpbrk (pat, "*?[");
+	len = strlen (pat);
+
+	if ( !meta )
+		{
+		sel_addlit (sp, pat);
+		return;
+		}
+
+	/* Strip trailing *s: if that leaves no wildcards, a prefix.  */
+	for (p = pat + len; p > pat && p [-1] == '*'; p--)
+		;
+
+	if ( p < pat + len && meta >= p )
+		{
+		*p = '\0';
+		sel_addprefix (sp, pat);
+		free (pat);
+		return;
+		}
+
+	sp->glob = sel_grow (sp->glob, (sp->nglob + 1) * sizeof (SEL_GLOB));
+
+	if ( !sel_compile (sp->glob + sp->nglob, pat) )
+		{
+		sp->nglob++;
+		free (pat);
+		return;
+		}
+
+	sp->slow = sel_grow (sp->slow, (sp->nslow + 1) * sizeof (char *));
+	sp->slow [sp->nslow++] = pat;
+}
+
+/*
+ *  Does NAME (lower case) match any pattern of SP?
+ */
+static int	sel_match	(
+		SEL_SET *	sp,
+		unsigned char *	name
+			)
+{
+unsigned char	*p;
+int	i, node;
+
+	if ( sp->nlit && *sel_slot (sp, (char *) name) )
+		return	1;
+
+	if ( sp->trieall )
+		return	1;
+
+	if ( sp->ntrie )
+		for (p = name, node = 0; *p; p++)
+			{
+			for (node = sp->trie [node].child; node >= 0 && sp->trie [node].c != *p; node = sp->trie [node].next)
+				;
+
+			if ( node < 0 )
+				break;
+
+			if ( sp->trie [node].end )
+				return	1;
+			}
+
+	for (i = 0; i < sp->nglob; i++)
+		if ( sel_run (sp->glob + i, name) )
+			return	1;
+
+	for (i = 0; i < sp->nslow; i++)
+		if ( match ((char *) name, sp->slow [i]) )
+			return	1;
+
+	return	0;
+}
+
+static char *	sel_copy	(
+		char *	pat
+			)
+{
+char	*p;
+
+	if ( !(p = strdup (pat)) )
+		{
+		fprintf (stderr, "out of memory\n");
+		exit (1);
+		}
+
+	return	strlocase (p);
+}
+
+/*
+ *  Add the patterns in the file NAME, one a line, to SP.
+ */
+static void	sel_load	(
+		SEL_SET *	sp,
+		char *		name
+			)
+{
+FILE	*fp;
+char	line [1024];
+size_t	len;
+
+	if ( !strcmp (name, "-") )
+		fp = stdin;
+	else if ( !(fp = fopen (name, "r")) )
+		{
+		perror (name);
+		exit (1);
+		}
+
+	while ( fgets (line, sizeof (line), fp) )
+		{
+		len = strcspn (line, "\r\n");
+		line [len] = '\0';
+
+		if ( len )
+			sel_add (sp, sel_copy (line));
+		}
+
+	if ( fp != stdin )
+		fclose (fp);
+}
+
+/*
+ *  Compile the patterns: the names on the command line and those in
+ *  the --include-from and --exclude-from files.
+ */
+void	sel_init	(void)
+{
+int	i;
+
+	for (i = goptind; i < gargc; i++)
+		sel_add (&sel_incl, sel_copy (gargv [i]));
+
+	if ( includefrom )
+		sel_load (&sel_incl, includefrom);
+
+	if ( excludefrom )
+		sel_load (&sel_excl, excludefrom);
+
+	for (i = 0; sel_types [i]; i++)
+		sel_add (&sel_xtypes, sel_copy (sel_types [i]));
+}
+
+/*
+ *  Are only some of the files selected?
+ */
+int	sel_some	(void)
+{
+	return	sel_incl.n || sel_excl.n;
+}
+
+/*
+ *  Start again on another list of files (the next saveset, or the
+ *  saveset itself after its catalogue entry): relative versions are
+ *  counted afresh.
+ */
+void	sel_restart	(void)
+{
+	sel_lastfile [0] = '\0';
+	sel_rank = 0;
+	sel_prunelen = 0;
+}
+
+/*
+ *  Is FN, a file name as found in the saveset, one of the files named on
+ *  the command line (or in the --include-from file), and not one in the
+ *  --exclude-from file?  All files are if no names were given.  With
+ *  --vms-match this must be called for every file, in order, for the
+ *  relative versions to be counted.
+ */
+int	selected	(
+		unsigned char *	fn
+			)
+{
+unsigned char	*cfname, name [256];
+size_t	i;
+
+	if ( !sel_incl.n && !sel_excl.n )
+		return	1;
+
+	if ( flag_vmsmatch )
+		return	sel_vms (fn);
+
+	cfname = dflag || !strchr ((char *) fn, ']') ? fn : (unsigned char *) strrchr ((char *) fn, ']') + 1;
+
+	for (i = 0; i < sizeof (name) - 1 && cfname [i] && (cflag || cfname [i] != ';'); i++)
+		name [i] = cfname [i] >= 'A' && cfname [i] <= 'Z' ? cfname [i] - 'A' + 'a' : cfname [i];
+
+	name [i] = '\0';
+
+	if ( sel_incl.n && !sel_match (&sel_incl, name) )
+		return	0;
+
+	return	!sel_excl.n || !sel_match (&sel_excl, name);
+}
+
+/*
+ *  Is the file FN to be extracted, being of a type we extract?  Only
+ *  without -e are the types in sel_types [] not.
+ */
+int	sel_type	(
+		unsigned char *	fn
+			)
+{
+unsigned char	name [256], *p;
+size_t	i;
+
+	if ( eflag )
+		return	1;
+
+	/* The type, without the version.  */
+	p = strrchr ((char *) fn, ']') ? (unsigned char *) strrchr ((char *) fn, ']') + 1 : fn;
+
+	for (i = 0; i < sizeof (name) - 1 && p [i] && p [i] != ';'; i++)
+		name [i] = p [i] >= 'A' && p [i] <= 'Z' ? p [i] - 'A' + 'a' : p [i];
+
+	name [i] = '\0';
+
+	return	!sel_match (&sel_xtypes, name);
+}
@@ -57,6 +57,7 @@
 #include	<errno.h>
 #include	<stdlib.h>
 #include	<string.h>
+#include	<time.h>
 
 #include	<sys/types.h>
 #if HAVE_MT_IOCTLS
@@ -68,25 +69,19 @@
 #include	<sys/stat.h>
 #endif
 #include	<sys/file.h>
+#ifndef	NO_UTIMENS
+#include	<sys/stat.h>
+#endif
+#ifndef	NO_MMAP
+#include	<sys/mman.h>
+#endif
 
 #include	"fabdef.h"
 
-#ifndef __vax
-/* The help claims that mkdir is declared in stdlib.h but it doesn't
-   seem to be true.  AXP/VMS 6.2, DECC ?.?.  On the other hand, VAX/VMS 6.2
-   seems to declare it in a way which conflicts with this definition.
-   This is starting to sound like a bad dream.  */
-int mkdir ();
-#endif
-
 #include	"vmsbackup.h"
+#include	"libvmsbackup.h"
 #include	"sysdep.h"
 
-static void debug_dump(const unsigned char* buffer, int dsize, int dtype);
-
-int match ();
-char *strlocase ();
-
 /* Byte-swapping routines.  Note that these do not depend on the size
    of datatypes such as short, long, etc., nor do they require us to
    detect the endianness of the machine we are running on.  It is
@@ -96,7 +91,7 @@ char *strlocase ();
    the byteorder used by all integers in a BACKUP saveset.
 */
 
-inline unsigned int	__cvt_ul (void *__addr)
+static inline unsigned int	__cvt_ul (void *__addr)
 {
 unsigned char *addr = (unsigned char *) __addr;
 
@@ -104,7 +99,7 @@ unsigned char *addr = (unsigned char *) __addr;
 		| addr[1]) << 8 | addr[0];
 }
 
-inline unsigned short	__cvt_uw (void *__addr)
+static inline unsigned short	__cvt_uw (void *__addr)
 {
 unsigned char *addr = (unsigned char *) __addr;
 
@@ -203,12 +198,38 @@ unsigned char	recfmt,		/* record format */
 
 FILE	*f	= NULL;
 
-/* Number of bytes we have read from the current file so far (or something
-   like that; see process_vbn).  */
-int	file_count;
-
-unsigned short	reclen, fix, recsize;
-int	vfcsize;
+/* With -P or --map-output: the mapping of F and how much of it has been
+   decoded into, and whether F has been preallocated (and is to be cut
+   to its length when closed) or written through vbn_direct () (and has
+   its full size).  */
+static unsigned char	*outmap;
+static size_t	outmapsz, outpos;
+static int	outalloc, outdirect;
+
+/* Zeros to be skipped before anything more is written to F.  */
+static size_t	outhole;
+
+/* With -W: F belongs to the writer threads as OUTWF, and what is
+   written to it is gathered in WBUF (WLEN bytes, to go at OUTPOS) before
+   it is handed to them.  */
+static int	wrmode;
+static WR_FILE	*outwf;
+static unsigned char	*wbuf;
+static size_t	wlen;
+
+/* Converting the data of the file being extracted from its record
+   format: how much of it has been taken, and the record going on (see
+   vb_convert () in libvms.c).  */
+static VB_CONV	conv;
+
+/* Nonzero while the file being extracted goes into the pax archive
+   rather than to F.  */
+static int	outpax;
+
+/* The times to give the file being extracted once it is all written:
+   its revision date (or creation date if it has none) as its mtime, and
+   its atime left as it is.  */
+static struct timespec	outtimes [2];
 
 /* Number of files we have seen.  */
 unsigned int nfiles;
@@ -217,6 +238,7 @@ unsigned int nfiles;
 unsigned long nblocks;
 
 int	input_fd;		/* tape file descriptor */
+BCK_INPUT	input;		/* ... and the block input layer on top of it */
 
 /* Command line stuff.  */
 
@@ -241,6 +263,73 @@ int flag_binary;
 /* More full listing (/FULL).  */
 int flag_full;
 
+/* Map a saveset on disk into memory instead of reading it block by
+   block (-m).  Ignored for tapes.  */
+int flag_mmap;
+
+/* Allocate the blocks of a file being extracted when it is opened, from
+   the size in its file record (-P), and decode into a mapping of it
+   (--map-output, which implies -P).  */
+int flag_prealloc, flag_mapout;
+
+/* Leave VBNs of zeros out of files extracted byte for byte, as holes
+   (on unless --no-sparse).  */
+int flag_sparse = 1;
+
+/* Number of threads writing and closing the files extracted (-W), and
+   the megabytes of data that may be waiting for them (--writer-memory);
+   see writer.c.  0 writes from the decoding thread.  */
+int writers, writer_mem = 64;
+
+/* Build the saveset index (-I) while reading a saveset on disk; see
+   index.c.  Without it an index that is already there is used.  */
+int flag_index;
+
+/* What to do about blocks failing their CRC or header checksum
+   (--crc): CRC_K_WARN reports them and uses them anyway, CRC_K_VERIFY
+   reports and drops them, CRC_K_SKIP does not check.  */
+int crcmode = CRC_K_WARN;
+
+/* Blocks which failed the CRC and the header checksum.  */
+unsigned long crcerrs, sumerrs;
+
+/* Redundancy group size from the saveset summary: after every GRPSIZE
+   data blocks BACKUP writes a block holding the XOR of their data, from
+   which any one of them can be rebuilt.  */
+unsigned grpsize;
+
+/* Nonzero once the summary (and GRPSIZE) of the saveset is known.  */
+int	sumseen;
+
+/* Highest block number (l_number) decoded so far, to drop duplicates.  */
+unsigned lastnum;
+
+/* Blocks rebuilt from their group, and duplicates dropped.  */
+unsigned long rebuilt, dupblocks;
+
+/* Data blocks passed over unchecked, holding nothing we want.  */
+unsigned long skipped;
+
+/* Number of threads to extract a saveset on disk with (-j); see
+   extract.c.  */
+int jobs;
+
+/* Number of savesets to read at once when given several (--parallel);
+   0 for as many as there are processors.  See multi.c.  */
+int parallel;
+
+/* Number of blocks to read ahead of the parser in a separate thread (-r);
+   0 reads synchronously.  Only used for savesets on disk which are not
+   mapped.  */
+int readahead;
+
+/* Size in megabytes of the buffer a tape is streamed into by a reader
+   thread (-T); 0 reads the tape synchronously.  The reader stops when the
+   buffer is HIGHWATER percent full and starts again when it has drained
+   to LOWWATER percent.  */
+int tapebuffer;
+int lowwater = 50, highwater = 100;
+
 /* Which save set are we reading?  */
 int	selset;
 
@@ -252,10 +341,78 @@ int 	goptind, gargc;
 
 int	setnr;
 
+/* Volume label and saveset name from the tape labels.  */
+char	volname[16], setname[32];
+
+/* Tape catalogue (-C) to record positions in and locate from; see
+   catalog.c.  */
+char	*catalog;
+
+/* Block map of a damaged saveset on disk to read the blocks of
+   (--blockmap), or to make first by carving the saveset (--carve); see
+   carve.c.  */
+char	*blockmap;
+int	flag_carve;
+
+/* Files of patterns of names to extract or list (--include-from) and
+   not to (--exclude-from), besides those on the command line; see
+   select.c.  */
+char	*includefrom, *excludefrom;
+
+/* Nonzero if the names are VMS file specifications (--vms-match).  */
+int	flag_vmsmatch;
+
+/* How -t lists files: LIST_K_TEXT, or a record each as JSON Lines or
+   CSV (--format); see format.c.  */
+int	listfmt;
+
+/* Nonzero if the files extracted go into a pax archive on the standard
+   output (--pax); see pax.c.  */
+int	flag_pax;
+
+/* Tape position of the block being decoded.  */
+off_t	blkpos = -1;
+
+/* Offset in the saveset on disk of the block being decoded.  */
+off_t	blkoff;
+
+/* Nonzero while we are adding the saveset being read to the catalogue.  */
+int	recording;
+
+/* Fast locate: when the catalogue lists every file of the saveset, these
+   are the tape positions of the blocks holding the file records we
+   want, and we seek from one to the next (see locate_next ()).  */
+static off_t	*tgt_pos;
+static int	tgt_n, tgt_next, tgt_alloc;
+int	locating;
+
+/* The names of the files we want, as the catalogue lists them, sorted.
+   With --vms-match relative versions are ranked among all the versions
+   of a file, so the files are selected from the catalogue, not from the
+   few file records we seek to.  */
+static char	**tgt_names;
+static int	tgt_nnames;
+
+static int	tgt_wanted (char *name);
+
+/* Set by process_file () while locating: a wanted file has been seen
+   since the last seek, and the file after it is not wanted.  */
+int	sel_seen, want_next;
+
 #define	LABEL_SIZE	80
+#define	TAPE_MAXREC	65536
+
+#ifndef	MAX
+#define	MAX(a, b)	((a) > (b) ? (a) : (b))
+#endif
+#ifndef	MIN
+#define	MIN(a, b)	((a) < (b) ? (a) : (b))
+#endif
 char	label[LABEL_SIZE];
 
-char	*block;
+/* Size of the stdio buffer of a file being extracted.  */
+#define	OUTBUF_SIZE	(256 * 1024)
+
 /* Default blocksize, as specified in -b option.  */
 int	blocksize = 32256;
 
@@ -264,44 +421,388 @@ struct	mtop	op;
 #endif
 
 
-FILE *	openfile(unsigned char *fn)
+/*
+ *  The file being extracted has been opened: preallocate and map it if
+ *  we were asked to.  Failures just leave it to grow as it is written.
+ */
+static void	out_open	(void)
 {
-unsigned char	ufn[256], ans[80], *p, *q, s, *ext;
-int	procf = 1;
+void	*p;
 
-	/* copy fn to ufn and convert to lower case */
-	for (p = fn, q = ufn; *p; p++, q++)
-		*q = isupper(*p) ? *p - 'A' + 'a' : *p;
+	outmap = NULL;
+	outpos = outhole = 0;
+	outalloc = outdirect = 0;
 
-	*q = '\0';
+	if ( wrmode )
+		outwf = wr_open (f, (char *) filename);
+
+	if ( !(flag_prealloc || flag_mapout) || filesize <= 0 )
+		return;
+
+#ifndef	NO_PREALLOC
+	if ( !(errno = posix_fallocate (fileno (f), 0, filesize)) )
+		outalloc = 1;
+	else if ( vflag )
+		perror ("preallocating output");
+#endif
+
+#ifndef	NO_MMAP
+	if ( !flag_mapout )
+		return;
+
+	if ( !outalloc && ftruncate (fileno (f), filesize) )
+		return;
+
+	outalloc = 1;
+
+	if ( MAP_FAILED == (p = mmap (NULL, filesize, PROT_READ | PROT_WRITE, MAP_SHARED, fileno (f), 0)) )
+		{
+		if ( vflag )
+			perror ("mmap of output failed, using write");
+		return;
+		}
 
-	/* convert the VMS to UNIX and make the directory path */
-	for (p = ufn, q = ++p; *q; q++)
+	outmap = p;
+	outmapsz = filesize;
+#endif
+}
+
+/*
+ *  Keep the times the file FP being extracted is to have.
+ */
+static void	out_settimes	(
+		VB_FILE *	fp
+			)
+{
+#ifndef	NO_UTIMENS
+	outtimes [0].tv_nsec = outtimes [1].tv_nsec = UTIME_OMIT;
+
+	if ( memcmp ("\0\0\0\0\0\0\0\0", fp->revised, 8) )
+		vt_timespec (fp->revised, &outtimes [1]);
+	else if ( memcmp ("\0\0\0\0\0\0\0\0", fp->created, 8) )
+		vt_timespec (fp->created, &outtimes [1]);
+#endif
+}
+
+/*
+ *  The times the file being extracted is to have, into TS [0] and TS [1]
+ *  as futimens () takes them, for extract.c to give those it writes.
+ */
+void	out_times	(
+		struct timespec *	ts
+			)
+{
+	ts [0] = outtimes [0];
+	ts [1] = outtimes [1];
+}
+
+/*
+ *  Give the file being extracted, open on FD, its times.  Done last,
+ *  when nothing more is to be written to it.
+ */
+static void	out_stamp	(
+		int	fd
+			)
+{
+#ifndef	NO_UTIMENS
+	if ( futimens (fd, outtimes) && vflag )
+		perror ((char *) filename);
+#endif
+}
+
+/*
+ *  Go on writing the file being extracted through stdio, from where the
+ *  decoding into its mapping got to.
+ */
+static void	out_unmap	(void)
+{
+#ifndef	NO_MMAP
+	if ( !outmap )
+		return;
+
+	munmap (outmap, outmapsz);
+	outmap = NULL;
+	fseek (f, outpos, SEEK_SET);
+#endif
+}
+
+/*
+ *  Hand what has been gathered for the writers to them.
+ */
+static void	out_flush	(void)
+{
+	if ( !wlen )
+		return;
+
+	wr_write (outwf, outpos, wbuf, wlen, OUTBUF_SIZE);
+	outpos += wlen;
+	wbuf = NULL;
+	wlen = 0;
+}
+
+static void	out_write (unsigned char *p, size_t n);
+
+/*
+ *  Skip the zeros seen last; LAST is set if nothing else comes, in which
+ *  case the last of them is written to give the file its size.
+ */
+static void	out_skip	(
+		int	last
+			)
+{
+size_t	n = outhole;
+
+	outhole = 0;
+
+	if ( wrmode )
+		{
+		out_flush ();
+		outpos += last ? n - 1 : n;
+
+		if ( last )
+			out_write ((unsigned char *) "", 1);
+		}
+	else if ( outmap )
+		outpos += n;
+	else if ( last )
+		{
+		fseek (f, n - 1, SEEK_CUR);
+		putc (0, f);
+		}
+	else	fseek (f, n, SEEK_CUR);
+}
+
+/*
+ *  Write N bytes at P to the file being extracted.
+ */
+static void	out_write	(
+		unsigned char *	p,
+		size_t		n
+			)
+{
+size_t	k;
+
+	if ( outhole )
+		out_skip (0);
+
+	if ( wrmode )
 		{
-		if (*q == '.' || *q == ']')
+		for ( ; n; n -= k, p += k)
 			{
-			s = *q;
-			*q = '\0';
+			if ( !wbuf )
+				wbuf = wr_alloc (OUTBUF_SIZE);
+
+			k = MIN (n, OUTBUF_SIZE - wlen);
+			memcpy (wbuf + wlen, p, k);
 
-			if(procf && dflag) mkdir(p, 0777);
+			if ( (wlen += k) == OUTBUF_SIZE )
+				out_flush ();
+			}
 
-			*q = '/';
+		return;
+		}
 
-			if (s == ']')
-				break;
+	if ( outmap )
+		{
+		if ( outpos + n <= outmapsz )
+			{
+			memcpy (outmap + outpos, p, n);
+			outpos += n;
+			return;
 			}
+
+		/* More than the file record said; rare enough.  */
+		out_unmap ();
+		}
+
+	fwrite (p, 1, n, f);
+}
+
+static void	out_putc	(
+		int	c
+			)
+{
+unsigned char	ch = c;
+
+	if ( wrmode )
+		{
+		out_write (&ch, 1);
+		return;
+		}
+
+	if ( outhole )
+		out_skip (0);
+
+	if ( outmap && outpos < outmapsz )
+		outmap [outpos++] = c;
+	else	{
+		out_unmap ();
+		putc (c, f);
+		}
+}
+
+/*
+ *  Is the N byte block at P all zeros?  Comparing it with itself one
+ *  byte on lets memcmp () do the work, a vector at a time.
+ */
+int	is_zero	(
+		unsigned char *	p,
+		size_t		n
+			)
+{
+	return	!n || (!p [0] && !memcmp (p, p + 1, n - 1));
+}
+
+/*
+ *  Write N bytes at P, which go to the file byte for byte: with sparse
+ *  output, VBNs of zeros are skipped rather than written.
+ */
+static void	out_data	(
+		unsigned char *	p,
+		size_t		n
+			)
+{
+size_t	i, j;
+
+	if ( !flag_sparse )
+		{
+		out_write (p, n);
+		return;
+		}
+
+	for (i = 0; i < n; i = j)
+		{
+		for (j = i; j < n && !is_zero (p + j, MIN (512, n - j)); j += 512)
+			;
+
+		if ( j > n )
+			j = n;
+
+		if ( j > i )
+			out_write (p + i, j - i);
+
+		for (i = j; j < n && is_zero (p + j, MIN (512, n - j)); j += 512)
+			;
+
+		if ( j > n )
+			j = n;
+
+		outhole += j - i;
+		}
+}
+
+/*
+ *  Close the file being extracted, cutting a preallocated file to the
+ *  length written.
+ */
+static void	closefile	(void)
+{
+long	len;
+
+	if ( outpax )
+		{
+		pax_close ();
+		outpax = 0;
+		return;
 		}
 
-	q++;
+	if ( !f )
+		return;
+
+	if ( outhole )
+		out_skip (1);
+
+	if ( wrmode )
+		{
+		/* The writers close it once it is all written.  */
+		out_flush ();
+		wr_close (outwf, outalloc && !outdirect ? (off_t) outpos : -1, outtimes);
+
+		f = NULL;
+		outwf = NULL;
+		outalloc = outdirect = 0;
+		return;
+		}
+
+	if ( outmap )
+		{
+		len = outpos;
+#ifndef	NO_MMAP
+		munmap (outmap, outmapsz);
+#endif
+		outmap = NULL;
+		}
+	else	{
+		fflush (f);
+		len = ftell (f);
+		}
+
+	if ( outalloc && !outdirect && ftruncate (fileno (f), len) )
+		perror ((char *) filename);
+
+	out_stamp (fileno (f));
+	fclose (f);
+	f = NULL;
+	outalloc = outdirect = 0;
+	outhole = 0;
+}
+
+/*
+ *  The name the VMS file FN is to have here, made in UFN: lower case,
+ *  with the directories if -d and the version if -c.
+ */
+static unsigned char *	unixname	(
+		unsigned char *	fn,
+		unsigned char *	ufn
+			)
+{
+unsigned char	*p, *q, s;
+
+	/* copy fn to ufn and convert to lower case */
+	for (p = fn, q = ufn; *p; p++, q++)
+		*q = isupper(*p) ? *p - 'A' + 'a' : *p;
+
+	*q = '\0';
+
+	/* convert the VMS to UNIX and make the directory path; a name
+	   with no directory is left as it is */
+	if ( !strchr ((char *) ufn, ']') )
+		p = q = ufn;
+	else	{
+		for (p = ufn, q = ++p; *q; q++)
+			{
+			if (*q == '.' || *q == ']')
+				{
+				s = *q;
+				*q = '/';
+
+				if (s == ']')
+					break;
+				}
+			}
+
+		q++;
 
-	if(!dflag) p = q;
+		if(!dflag) p = q;
+		}
 
 	/* strip off the version number */
 	for (; *q && *q != ';'; q++)
-		if( *q == '.') ext = q;
+		;
 
 	*q = (cflag) ?  ':' : '\0';
 
+	return	p;
+}
+
+FILE *	openfile(unsigned char *fn)
+{
+unsigned char	ufn[256], ans[80], *p;
+int	procf = 1;
+FILE	*fp = NULL;
+
+	p = unixname (fn, ufn);
+
 	if (procf && wflag)
 		{
 		printf("extract %s [ny]", filename);
@@ -310,11 +811,12 @@ int	procf = 1;
 		if(*ans != 'y') procf = 0;
 		}
 
-	/* open the file for writing */
-	if (procf)
-		return	fopen(p, "w");
+	/* open the file for writing (making its directories), with a
+	   buffer that takes the spans of process_vbn () in few writes */
+	if (procf && (fp = dir_fopen((char *) p)))
+		setvbuf (fp, NULL, _IOFBF, OUTBUF_SIZE);
 
-	return	NULL;
+	return	fp;
 }
 
 void	process_summary (
@@ -325,10 +827,19 @@ void	process_summary (
 size_t	c;
 unsigned char	*text;
 unsigned short grp = 0377, usr = 0377, itmcode, itmlen;
-unsigned id, blksz = 0, grpsz = 0, bufcnt = 0;
+unsigned id = 0, blksz = 0, grpsz = 0, bufcnt = 0;
 ITM *itm;
 
-	if (!tflag)
+	/* The group size we need whether we list or not.  */
+	grpsize = 0;
+	sumseen = 1;
+
+	if ( buflen > 2 && bufp[0] == 1 && bufp[1] == 1 )
+		for ( c = 2; c + 4 <= buflen && (itmcode = __cvt_uw (bufp + c + 2)); c += itmlen + 4)
+			if ( (itmlen = __cvt_uw (bufp + c)) >= 2 && itmcode == 14 )
+				grpsize = __cvt_uw (bufp + c + 4);
+
+	if (!tflag || listfmt)
 		return;
 
 	/* check the header word */
@@ -445,9 +956,6 @@ ITM *itm;
 				printf("Undefined item code 0x%04x\n", itmcode);
 				/* I guess we'll silently ignore these, for future
 				   expansion.  */
-#ifdef	DEBUG
-				debug_dump(text, itmlen, itmcode);
-#endif
 				break;
 			}
 
@@ -468,263 +976,109 @@ void	process_file	(
 		size_t		buflen
 			)
 {
-int	i, c, procf;
-short	itmlen, lnch, itmcode, dtlen = 0;
-unsigned char	*p, *q, *pdata, *cfname, *sfilename,
-	date1[24] = " <None specified>", date2[24] = " <None specified>",
+int	i, procf;
+short	dtlen = 0;
+unsigned char	date1[24] = " <None specified>", date2[24] = " <None specified>",
 	date3[24] = " <None specified>", date4[24] = " <None specified>";
+VB_FILE	fa;
+unsigned char	ufn [256];
 
-unsigned nblk, ablk, protection = 0,
 /* Number of blocks which should appear in output.  This doesn't
    seem to always be the same as nblk.  */
-	blocks, ablocks;
+unsigned	blocks, ablocks;
 
-unsigned short reviseno = 0, grp = 0377, usr = 0377, fid[3] = {0,0,0}, extension = 0;
-ITM	*itm;
 
-
-	/* check the header word */
-	if (bufp[0] != 1 || bufp[1] != 1)
+	/* The items of the header: see vb_fileattr () in libvms.c.  */
+	if ( vb_fileattr (&fa, bufp, buflen) )
 		{
 		printf ("Invalid data header word 0x%02x%02x\n", bufp[0], bufp[1]);
 		return;
 		}
 
-	bufp += 2;
+	strcpy ((char *) filename, fa.name);
+	recfmt = fa.recfmt;
+	recatt = fa.recatt;
 
-	for ( itm = (ITM *) bufp, c = 2; c < buflen; c += itmlen + 4,
-			itm = (ITM *) (((void *) itm) + (itmlen + 4)))
-		{
-		itmlen	= __cvt_uw (&itm->w_size);
-		itmcode	= __cvt_uw (&itm->w_type);
+	if ( memcmp("\0\0\0\0\0\0\0\0", fa.created, 8) && !(time_vms_to_asc (&dtlen, date4, fa.created) & 1) )
+		strcpy (date4, "error converting date");
+
+	if ( memcmp("\0\0\0\0\0\0\0\0", fa.revised, 8) && !(time_vms_to_asc (&dtlen, date1, fa.revised) & 1) )
+		strcpy (date1, "error converting date");
 
-		pdata	= itm->t_text;
+	/* Expires; "<None specified>" when all zeroes, as BACKUP has it.  */
+	if ( memcmp("\0\0\0\0\0\0\0\0", fa.expires, 8) && !(time_vms_to_asc (&dtlen, date2, fa.expires) & 1) )
+		strcpy (date2, "error converting date");
 
-#ifdef DEBUG
-		debug_dump(data, dsize, dtype);
+	if ( memcmp("\0\0\0\0\0\0\0\0", fa.backup, 8) && !(time_vms_to_asc (&dtlen, date3, fa.backup) & 1) )
+		strcpy (date3, "error converting date");
+
+#ifdef	DEBUG
+	if (debugflag)
+		printf("RMS record's: fmt = %02x, attr = %02x, sz = %d octets, VFC = %d octets\n",
+			recfmt, recatt, fa.recsize, fa.vfcsize);
 #endif
 
-		/* Probably should define constants for the cases in this
-		   switch, but I don't know anything about whether they
-		   have "official" names we should be using or anything
-		   like that.  */
-		switch (itmcode)
-			{
-			case 0x2a:
-				/* Copy the text into filename, and '\0'-terminate it.  */
-				p = pdata;
-				q = filename;
-				for (i = 0; i < itmlen && q < filename + sizeof (filename) - 1; i++)
-					*q++ = *p++;
-
-				*q = '\0';
-				break;
+	filesize = fa.size;
+	blocks	= (filesize + 511) / 512;
+	afilesize = fa.ablk * 512;
+	ablocks	= fa.ablk;
 
-			case 0x2b:
-				/* In my example, two bytes, 0x1 0x2.  */
-				break;
+#ifdef	DEBUG
+	if (debugflag)
+		{
+		printf("nbk = %d, abk = %d, lnch = %d\n", fa.nblk, fa.ablk, fa.lnch);
+		printf("filesize = 0x%x, afilesize = 0x%x\n", filesize, afilesize);
+		}
+#endif
 
-			case 0x2c:
-				/* In my example, 6 bytes,
-				   0x7a 0x2 0x57 0x0 0x1 0x1.  */
-				fid[0] = __cvt_uw(pdata);
-				fid[1] = __cvt_uw(pdata + 2);
-				fid[2] = __cvt_uw(pdata + 4);
-				break;
+	/* open the file */
+	if ( f || outpax )
+		{
+		closefile ();
+		conv.count = conv.reclen = conv.hdrlen = 0;
+		}
 
-			case 0x2e:
-				/* In my example, 4 bytes, 0x00000004.  Maybe
-				   the allocation.  */
-				break;
+	procf = locating ? tgt_wanted ((char *) filename) : selected (filename);
 
-			case 0x2f:
-				if (itmlen == 4)
-					{
-					usr = __cvt_uw (pdata);
-					grp = __cvt_uw (pdata + 2);
-					}
-				break;
-
-			case 0x34:
-				recfmt = *pdata;
-				recatt = *(pdata + 1);
-				recsize = __cvt_uw (pdata + 2);
-
-				/* bytes 4-7 unaccounted for.  */
-
-				ablk = __cvt_uw (pdata + 6);
-				nblk = __cvt_uw (pdata + 10)
-					/* Adding in the following amount is a
-					   change that I brought over from
-					   vmsbackup 3.1.  The comment there
-					   said "subject to confirmation from
-					   backup expert here" but I'll put it
-					   in until someone complains.  */
-					+ (64 * 1024) * __cvt_uw (pdata + 8);
-
-				lnch = __cvt_uw (pdata + 12);
-				/* byte 14 unaccounted for */
-				if ( !(vfcsize = pdata + 15) )
-					vfcsize = 2;
-
-				/* bytes 16-31 unaccounted for */
-				extension = __cvt_uw (pdata + 18);
-				break;
-
-			case 0x2d:
-				/* In my example, 6 bytes.  hex 2b3c 2000 0000.  */
-				break;
-
-			case 0x30:
-				/* In my example, 2 bytes.  0x44 0xee.  */
-				protection = __cvt_uw (pdata);
-				break;
+	if ( recording )
+		cat_addfile (setnr, blkpos, (char *) filename);
 
-			case 0x31:
-				/* In my example, 2 bytes.  hex 0000.  */
-				break;
-			case 0x32:
-				/* In my example, 1 byte.  hex 00.  */
-				break;
-			case 0x33:
-				/* In my example, 4 bytes.  hex 00 0000 00.  */
-				break;
-			case 0x4b:
-				/* In my example, 2 bytes.  Hex 01 00.  */
-				break;
-			case 0x50:
-				/* In my example, 1 byte.  hex 00.  */
-				break;
-			case 0x57:
-				/* In my example, 1 byte.  hex 00.  */
-				break;
-			case 0x4f:
-				/* In my example, 4 bytes.  05 0000 00.  */
-				break;
-			case 0x35:
-				/* In my example, 2 bytes.  04 00.  */
-				reviseno = __cvt_uw (pdata);
-				break;
-
-			case 0x36:
-				/* In my example, 8 bytes.  Presumably a date.  */
-				if ( memcmp("\0\0\0\0\0\0\0\0", pdata, 8) && !(time_vms_to_asc (&dtlen, date4, pdata) & 1) )
-					strcpy (date4, "error converting date");
-				break;
-			case 0x37:
-				/* In my example, 8 bytes.  Presumably a date.  */
-				if ( memcmp("\0\0\0\0\0\0\0\0", pdata, 8) && !(time_vms_to_asc (&dtlen, date1, pdata) & 1) )
-					strcpy (date1, "error converting date");
-				break;
-			case 0x38:
-				/* In my example, 8 bytes.  Presumably expires
-				   date, since my examples has all zeroes here
-				   and BACKUP prints "<None specified>" for
-				   expires.  */
-				if ( memcmp("\0\0\0\0\0\0\0\0", pdata, 8) && !(time_vms_to_asc (&dtlen, date2, pdata) & 1) )
-					strcpy (date2, "error converting date");
-				break;
-			case 0x39:
-				/* In my example, 8 bytes.  Presumably a date.  */
-				if ( memcmp("\0\0\0\0\0\0\0\0", pdata, 8) && !(time_vms_to_asc (&dtlen, date3, pdata) & 1) )
-					strcpy (date3, "error converting date");
-				break;
-			case 0x47:
-				/* In my example, 4 bytes.  01 00c6 00.  */
-				break;
-			case 0x48:
-				/* In my example, 2 bytes.  88 aa.  */
-				break;
-			case 0x4a:
-				/* In my example, 2 bytes.  01 00.  */
-				break;
-				/* then comes 0x0, offset 0x2b7.  */
-			}
-		}
-
-#ifdef	DEBUG
-	if (debugflag)
-		printf("RMS record's: fmt = %02x, attr = %02x, sz = %d octets, VFC = %d octets\n",
-			recfmt, recatt, recsize, vfcsize);
-#endif
-
-	/* I believe that "512" here is a fixed constant which should not
-	   depend on the device, the saveset, or anything like that.  */
-	filesize = (nblk - 1) * 512 + lnch;
-	blocks	= (filesize + 511) / 512;
-	afilesize = ablk * 512;
-	ablocks	= ablk;
-
-#ifdef	DEBUG
-	if (debugflag)
+	/* When locating from the catalogue, we are done with the current
+	   target once a file we do not want follows one we do.  */
+	if ( locating )
 		{
-		printf("nbk = %d, abk = %d, lnch = %d\n", nblk, ablk, lnch);
-		printf("filesize = 0x%x, afilesize = 0x%x\n", filesize, afilesize);
-		}
-#endif
+		if ( procf )
+			sel_seen = 1;
 
-	/* open the file */
-	if ( f )
-		{
-		fclose(f);
-		file_count = reclen = 0;
+		want_next = sel_seen && !procf;
 		}
 
-	procf = 0;
-
-	if (goptind < gargc)
-		{
-		cfname = dflag ? filename : strrchr(filename, ']') + 1;
-
-		if ( !(sfilename = malloc (strlen (cfname) + 5)) )
-			{
-			fprintf (stderr, "out of memory\n");
-			exit (1);
-			}
-
-		if (cflag)
-			strcpy(sfilename, cfname);
-		else	{
-			for (i = 0; i < strlen(cfname) && cfname[i] != ';'; i++)
-				sfilename[i] = cfname[i];
-
-			sfilename[i] = '\0';
-			}
 
-		for (i = goptind; i < gargc; i++)
-			procf |= match (strlocase(sfilename),strlocase(gargv[i]));
+	if ( tflag && procf && listfmt )
+		fmt_file (&fa, blocks);
 
-		free (sfilename);
-		}
-	else	procf = 1;
-
-
-	if ( tflag && procf && !flag_full )
-#ifdef HAVE_STARLET
+	if ( tflag && procf && !flag_full && !listfmt )
 		printf ("%-52s %8d %s\n", filename, blocks, date4);
-#else
-		printf ("%-52s %8d\n", filename, blocks);
-#endif
 
-	if ( tflag && procf && flag_full )
+	if ( tflag && procf && flag_full && !listfmt )
 		{
-		printf ("%-30.30s File ID:  (%d,%d,%d)\n", filename,fid[0], fid[1], fid[2]);
-		printf ("  Size:       %6d/%-6d    Owner:    [%06o,%06o]     Revision:     %6d\n", blocks, ablocks, grp, usr, reviseno);
+		printf ("%-30.30s File ID:  (%d,%d,%d)\n", filename, fa.fid[0], fa.fid[1], fa.fid[2]);
+		printf ("  Size:       %6d/%-6d    Owner:    [%06o,%06o]     Revision:     %6d\n", blocks, ablocks, fa.uic_group, fa.uic_member, fa.revision);
 		printf ("  Protection: (");
 
 		for (i = 0; i <= 3; i++)
 			{
 			printf("%c:", "SOGW"[i]);
-			if (((protection >> (i * 4)) & 1) == 0)
+			if (((fa.protection >> (i * 4)) & 1) == 0)
 				printf("R");
 
-			if (((protection >> (i * 4)) & 2) == 0)
+			if (((fa.protection >> (i * 4)) & 2) == 0)
 				printf("W");
 
-			if (((protection >> (i * 4)) & 4) == 0)
+			if (((fa.protection >> (i * 4)) & 4) == 0)
 				printf("E");
 
-			if (((protection >> (i * 4)) & 8) == 0)
+			if (((fa.protection >> (i * 4)) & 8) == 0)
 				printf("D");
 
 			if (i != 3)
@@ -733,12 +1087,10 @@ ITM	*itm;
 
 		printf(")\n");
 
-#ifdef HAVE_STARLET
 		printf("  Created:  %s\n", date4);
-		printf("  Revised:  %s (%u)\n", date1, reviseno);
+		printf("  Revised:  %s (%u)\n", date1, fa.revision);
 		printf("  Expires:  %s\n", date2);
 		printf("  Backup:   %s\n", date3);
-#endif
 
 		printf ("  File Organization:  ");
 		switch (recfmt & 0xf0)
@@ -751,7 +1103,7 @@ ITM	*itm;
 			}
 		printf("\n");
 
-		printf("  File attributes:    Allocation %u, Extend %d", ablocks, extension);
+		printf("  File attributes:    Allocation %u, Extend %d", ablocks, fa.extension);
 		printf("\n");
 
 		printf ("  Record format:      ");
@@ -759,18 +1111,18 @@ ITM	*itm;
 			{
 			case FAB$C_UDF: printf ("(UDF/Undefined)"); break;
 			case FAB$C_FIX: printf ("Fixed length");
-				if (recsize)
-					printf (" %u byte records", recsize);
+				if (fa.recsize)
+					printf (" %u byte records", fa.recsize);
 				break;
 
 			case FAB$C_VAR: printf ("Variable length");
-				if (recsize)
-					printf (", maximum %u bytes", recsize);
+				if (fa.recsize)
+					printf (", maximum %u bytes", fa.recsize);
 				break;
 
 			case FAB$C_VFC: printf ("VFC");
-				if (recsize)
-					printf (", maximum %u bytes", recsize);
+				if (fa.recsize)
+					printf (", maximum %u bytes", fa.recsize);
 				break;
 
 			case FAB$C_STM:	printf ("Stream"); break;
@@ -790,169 +1142,197 @@ ITM	*itm;
 		printf ("\n");
 		}
 
-	if ( xflag && procf)
+	if ( xflag && procf && sel_type (filename) && flag_pax )
+		{
+		pax_file (&fa, (char *) unixname (filename, ufn), flag_binary);
+		vb_convstart (&conv, &fa, flag_binary);
+		outpax = 1;
+
+		if ( vflag )
+			printf ("archiving %s\n", filename);
+		}
+	else if ( xflag && procf && sel_type (filename) )
 		{
 		/* open file */
-		if ( (f = openfile(filename)) && vflag)
+		if ( (f = openfile(filename)) )
+			{
+			vb_convstart (&conv, &fa, flag_binary);
+			out_settimes (&fa);
+			out_open ();
+			}
+
+		if ( f && vflag)
+			{
+			/* After any --format records before it.  */
+			fmt_flush ();
 			printf("extracting %s\n", filename);
+			}
 		}
 
 	++nfiles;
 	nblocks += blocks;
 }
 
+/*
+ *  Where vb_convert () puts the data of the file being extracted.
+ */
+static int	out_conv	(
+		void *			arg,
+		const unsigned char *	p,
+		size_t			n,
+		int			span
+			)
+{
+	if ( outpax )
+		pax_write (p, n);
+	else if ( span )
+		out_data ((unsigned char *) p, n);
+	else if ( n == 1 )
+		out_putc (*p);
+	else	out_write ((unsigned char *) p, n);
+
+	return	0;
+}
+
 /*
  *
  *  process a virtual block record (file record)
  *
+ *  The data is converted from the record format by vb_convert () (in
+ *  libvms.c) and goes out a span at a time rather than a byte at a time.
+ *
  */
 void	process_vbn	(
 		unsigned char *	buffer,
 		size_t		rsize
 		)
 {
-int	c, i, j;
-
-	if ( !f )
+	if ( !f && !outpax )
 		return;
 
-	for (i = 0; file_count + i < filesize && i < rsize; )
+	if ( vb_convert (&conv, buffer, rsize, out_conv, NULL) == VB_E_RECFMT )
 		{
-		switch (recfmt)
+		if ( outpax )
 			{
-			case FAB$C_FIX:
-				reclen = reclen ? reclen : recsize;
-
-				fputc(buffer[i], f);
-				i++;
-				reclen--;
-				break;
-
-			case FAB$C_VAR:
-			case FAB$C_VFC:
-				if (reclen == 0)
-					{
-					fix = reclen = __cvt_uw (&buffer[i]);
-					if (flag_binary)
-						for (j = 0; j < 2; j++)
-							fputc (buffer[i+j], f);
-
-					i += 2;
-					if (recfmt == FAB$C_VFC)
-						{
-						if (flag_binary)
-							for (j = 0; j < vfcsize; j++)
-								fputc (buffer[i+j], f);
-
-						i += vfcsize;
-						reclen -= vfcsize;
-						}
-					}
-				else if (reclen == fix && recatt == FAB$M_FTN)
-					{
-					/****
-					if (buffer[i] == '0')
-						fputc('\n', f);
-					else if (buffer[i] == '1')
-						fputc('\f', f);
-					*** sow ***/
-					fputc(buffer[i], f); /** sow **/
-					i++;
-					reclen--;
-					}
-				else	{
-					fputc(buffer[i], f);
-					i++;
-					reclen--;
-					}
-
-
-
-				if ( !reclen )
-					{
-					if (!flag_binary)
-						fputc('\n', f);
-
-					if (i & 1)
-						{
-						if (flag_binary)
-							fputc (buffer[i], f);
-
-						i++;
-						}
-					}
-				break;
-
-			case FAB$C_STM:
-			case FAB$C_STMLF:
-				if (reclen < 0)
-					printf("STREAM\n");
-
-				if ( !reclen == 0)
-					reclen = 512;
+			pax_drop ();
+			outpax = 0;
+			}
+		else	{
+			closefile ();
+			remove(filename);
+			}
 
-				c = buffer[i++];
-				reclen--;
+		fprintf(stderr, "Invalid record format =0x%02x/%d\n", recfmt, recfmt);
+		}
+}
 
-				if (c == '\n')
-					reclen = 0;
 
-				fputc(c, f);
-				break;
+/*
+ *  If the file being extracted takes the data of its VBN records byte for
+ *  byte, so that they can be written at their VBN in any order, return
+ *  the descriptor to write them to and, in *SIZEP, the size of the file;
+ *  *CRP is set if CRs are to become LFs on the way.  Otherwise -1.
+ */
+int	vbn_direct	(
+		int *	sizep,
+		int *	crp
+			)
+{
+	if ( !f )
+		return	-1;
 
-			case FAB$C_STMCR:
-				c = buffer[i++];
+	switch (recfmt)
+		{
+		case FAB$C_VAR:
+		case FAB$C_VFC:
+			if ( !flag_binary )
+				return	-1;
+			/* fall through */
+
+		case FAB$C_FIX:
+		case FAB$C_STM:
+		case FAB$C_STMLF:
+		case FAB$C_STMCR:
+			/* Positional writes go to the file, not the map
+			   or the writers.  */
+			out_unmap ();
+
+			if ( wrmode )
+				out_flush ();
+
+			outdirect = 1;
+
+			*sizep = filesize;
+			*crp = recfmt == FAB$C_STMCR && !flag_binary;
+			return	fileno (f);
+		}
 
-				if (c == '\r' && !flag_binary)
-					fputc('\n', f);
-				else	fputc(c, f);
+	return	-1;
+}
 
-				break;
+/*
+ *  The first END bytes of the file being extracted have been written by
+ *  vbn_direct ()'s caller: carry on after them with process_vbn ().
+ */
+void	vbn_resume	(
+		off_t	end
+			)
+{
+	if ( !f )
+		return;
 
-			default:
-				fclose(f); f = NULL;
-				remove(filename);
-				fprintf(stderr, "Invalid record format =0x%02x/%d\n", recfmt, recfmt);
-				return;
-			}
+	if ( wrmode )
+		{
+		out_flush ();
+		outpos = end;
 		}
+	else	fseek (f, end, SEEK_SET);
 
-	file_count += i;
+	outhole = 0;
+	conv.count = end;
+	conv.reclen = conv.hdrlen = 0;
 }
 
-
 #define	BBH$K_SZ	256
 
-void	scan_bbh	(
-		char	*bufp
-
-		)
+void	scan_bbh	(void)
 {
 int	status;
 unsigned short	bhsize;
 unsigned	bsize, i = 0;
-BCK_BLK_HDR *	bbh = (BCK_BLK_HDR *) bufp;
+BCK_BLK_HDR *	bbh;
+char	*bufp;
 
 	printf("[0x%08X] Start scanning for Backup Block Header ...\n",
-		lseek (input_fd, 0, SEEK_CUR) - blocksize);
+		(unsigned) (inp_tell (&input) - blocksize));
 
 	do	{
 		/*
-		 * Reading by 512 bytes
+		 * Reading by 256 bytes; when the saveset is mapped this is
+		 * just a pointer bump.
 		 */
-		if ( BBH$K_SZ != (status = read(input_fd, block, BBH$K_SZ)) )
+		if ( 0 > (status = inp_read(&input, &bufp, BBH$K_SZ)) )
 			{
-			fprintf(stderr, "Error reading %d, got %d (expected %d), errno = %d", input_fd, 512, status, errno);
+			fprintf(stderr, "Error reading %d, got %d (expected %d), errno = %d", input_fd, status, BBH$K_SZ, errno);
 			exit(1);
 			}
 
+		/* The end of the saveset: let the caller find it too.  */
+		if ( status != BBH$K_SZ )
+			{
+			printf("No Backup Block Header found before the end of the saveset\n");
+			return;
+			}
+
+		bbh = (BCK_BLK_HDR *) bufp;
+
 		bhsize	= __cvt_uw (&bbh->w_size);
 		bsize	= __cvt_ul (&bbh->l_blocksize);
 
 #ifdef	DEBUG
 		if (debugflag)
 			fprintf(stderr, "[0x%08X] Backup block: header length = %d, size = %d, type (DATA=1/XOR=2) = %5d\n",
-				lseek (fd, 0, SEEK_CUR) - BBH$K_SZ, bhsize, bsize, bbh->w_applic);
+				(unsigned) (inp_tell (&input) - BBH$K_SZ), bhsize, bsize, bbh->w_applic);
 #endif
 
 		status = 0;
@@ -978,7 +1358,322 @@ BCK_BLK_HDR *	bbh = (BCK_BLK_HDR *) bufp;
 
 
 	/* Set file position to begin of the Backup Block Header */
-	lseek (input_fd, -BBH$K_SZ, SEEK_CUR);
+	inp_seek (&input, inp_tell (&input) - BBH$K_SZ);
+}
+
+/*
+ *  Check the block of LEN bytes at BLK, which is at offset OFF of the
+ *  saveset, as --crc says.  Returns nonzero if it is not to be used as
+ *  it is: with --crc verify, or with --crc warn in a saveset with
+ *  redundancy groups, where it is to be rebuilt if it can be and used as
+ *  it is if not (see group_bad ()).
+ */
+int	blk_verify	(
+		unsigned char *	blk,
+		int		len,
+		off_t		off
+			)
+{
+int	status;
+BCK_BLK_HDR *	bbh = (BCK_BLK_HDR *) blk;
+
+	if ( crcmode == CRC_K_SKIP || !(status = blk_check (blk, len)) )
+		return	0;
+
+	if ( status & BLK_M_CRC )
+		crcerrs++;
+
+	if ( status & BLK_M_CHECKSUM )
+		sumerrs++;
+
+	fprintf (stderr, "[0x%08X] Block %u: %s%s%s\n", (unsigned) off, __cvt_ul (&bbh->l_number),
+		status & BLK_M_CRC ? "CRC error" : "",
+		status == (BLK_M_CRC | BLK_M_CHECKSUM) ? ", " : "",
+		status & BLK_M_CHECKSUM ? "header checksum error" : "");
+
+	if ( crcmode == CRC_K_VERIFY )
+		{
+		fprintf (stderr, "[0x%08X] Block %u not used\n", (unsigned) off, __cvt_ul (&bbh->l_number));
+		return	1;
+		}
+
+	/* In a saveset with redundancy groups we would rather rebuild it.  */
+	return	grpsize != 0;
+}
+
+/*
+ *  Redundancy groups.  GRP_XOR holds the XOR of the data (everything
+ *  after the block header) of the GRP_COUNT data blocks of the current
+ *  group we have.  Once a block of the group is lost (GRP_LOST), the
+ *  ones after it are kept in GRP_PEND until the XOR block comes along
+ *  and the lost one can be rebuilt and decoded ahead of them.  A block
+ *  lost to a failed check with --crc warn is kept too, marked in
+ *  GRP_PENDBAD, in case it cannot be.
+ */
+static unsigned char	*grp_xor;
+static int	grp_count, grp_lost;
+static char	**grp_pend;
+static off_t	*grp_pendoff;
+static char	*grp_pendbad;
+static int	grp_npend;
+
+static void	decode_block (char *bufp, off_t off);
+
+/*
+ *  DST ^= SRC for LEN bytes, a machine word at a time where we can.
+ */
+static void	xor_block	(
+		unsigned char *	dst,
+		unsigned char *	src,
+		size_t		len
+			)
+{
+unsigned long	*d, *s;
+
+	if ( !(((size_t) dst | (size_t) src) % sizeof (unsigned long)) )
+		{
+		for (d = (unsigned long *) dst, s = (unsigned long *) src;
+				len >= 4 * sizeof (unsigned long); len -= 4 * sizeof (unsigned long), d += 4, s += 4)
+			{
+			d [0] ^= s [0];
+			d [1] ^= s [1];
+			d [2] ^= s [2];
+			d [3] ^= s [3];
+			}
+
+		dst = (unsigned char *) d;
+		src = (unsigned char *) s;
+		}
+
+	while ( len-- )
+		*dst++ ^= *src++;
+}
+
+/*
+ *  Decode the blocks held back for the group, and the bad ones among
+ *  them as they are if BAD, and start a new group.
+ */
+static void	group_flush	(
+		int	bad
+			)
+{
+int	i;
+
+	for (i = 0; i < grp_npend; i++)
+		{
+		if ( grp_pendbad [i] && bad )
+			fprintf (stderr, "[0x%08X] Block used as it is\n", (unsigned) grp_pendoff [i]);
+
+		if ( !grp_pendbad [i] || bad )
+			decode_block (grp_pend [i], grp_pendoff [i]);
+
+		free (grp_pend [i]);
+		}
+
+	grp_npend = grp_count = grp_lost = 0;
+
+	if ( grp_xor )
+		memset (grp_xor, 0, blocksize);
+}
+
+/*
+ *  A data block of the current group has been lost (bad header or failed
+ *  check).
+ */
+static void	group_lost	(void)
+{
+	if ( grpsize )
+		grp_lost++;
+}
+
+/*
+ *  Hold the block BLK at offset OFF of the saveset back until the group
+ *  ends; BAD if it failed its check.
+ */
+static void	group_hold	(
+		unsigned char *	blk,
+		off_t		off,
+		int		bad
+			)
+{
+	if ( !(grp_pend = realloc (grp_pend, (grp_npend + 1) * sizeof (char *)))
+		|| !(grp_pendoff = realloc (grp_pendoff, (grp_npend + 1) * sizeof (off_t)))
+		|| !(grp_pendbad = realloc (grp_pendbad, grp_npend + 1))
+		|| !(grp_pend [grp_npend] = malloc (blocksize)) )
+		{
+		fprintf (stderr, "out of memory\n");
+		exit (1);
+		}
+
+	memcpy (grp_pend [grp_npend], blk, blocksize);
+	grp_pendoff [grp_npend] = off;
+	grp_pendbad [grp_npend++] = bad;
+}
+
+/*
+ *  The data block BLK at offset OFF of the saveset failed its check, and
+ *  is lost to the group.  With --crc warn it is held back as well, to be
+ *  used as it is if the group cannot rebuild it: a warning is not to
+ *  cost any data.
+ */
+static void	group_bad	(
+		unsigned char *	blk,
+		off_t		off
+			)
+{
+	group_lost ();
+
+	if ( grpsize && crcmode != CRC_K_VERIFY )
+		group_hold (blk, off, 1);
+}
+
+/*
+ *  The XOR block XBLK of the current group has arrived (NULL if it was
+ *  lost too): rebuild the lost block if there is exactly one, and decode
+ *  the blocks held back, bad ones too if it could not be rebuilt.
+ */
+static void	group_end	(
+		unsigned char *	xblk,
+		off_t		off
+			)
+{
+char	*blk;
+BCK_BLK_HDR *	bbh;
+
+	if ( grp_lost == 1 && xblk && grp_count < grpsize )
+		{
+		if ( !(blk = malloc (blocksize)) )
+			{
+			fprintf (stderr, "out of memory\n");
+			exit (1);
+			}
+
+		/* Header from the XOR block, made out to be a data block
+		   (with no number and no CRC); data from the XOR.  */
+		memcpy (blk, xblk, blocksize);
+		xor_block ((unsigned char *) blk + BBH$K_SZ, grp_xor + BBH$K_SZ, blocksize - BBH$K_SZ);
+
+		bbh = (BCK_BLK_HDR *) blk;
+		memset (&bbh->w_applic, 0, sizeof (bbh->w_applic));
+		*(unsigned char *) &bbh->w_applic = 1;
+		memset (&bbh->l_number, 0, sizeof (bbh->l_number));
+		memset (&bbh->l_crc, 0, sizeof (bbh->l_crc));
+
+		fprintf (stderr, "[0x%08X] Lost block rebuilt from its redundancy group\n", (unsigned) off);
+		rebuilt++;
+
+		decode_block (blk, -1);
+		free (blk);
+		group_flush (0);
+		return;
+		}
+
+	if ( grp_lost )
+		fprintf (stderr, "[0x%08X] %d block(s) of the redundancy group lost, cannot rebuild\n",
+			(unsigned) off, grp_lost);
+
+	group_flush (1);
+}
+
+/*
+ *  Take the data or XOR block BLK at offset OFF of the saveset through
+ *  the redundancy group and duplicate checks.  Returns 1 if it is to be
+ *  decoded now, 0 if not (XOR block, duplicate, or held back).
+ */
+int	group_take	(
+		unsigned char *	blk,
+		off_t		off
+			)
+{
+BCK_BLK_HDR *	bbh = (BCK_BLK_HDR *) blk;
+unsigned	number = __cvt_ul (&bbh->l_number);
+
+	if ( __cvt_uw (&bbh->w_applic) == 2 )
+		{
+		group_end (blk, off);
+		return	0;
+		}
+
+	if ( number && number <= lastnum )
+		{
+		if ( vflag )
+			fprintf (stderr, "[0x%08X] Block %u seen before, dropped\n", (unsigned) off, number);
+
+		dupblocks++;
+		return	0;
+		}
+
+	if ( number )
+		lastnum = number;
+
+	/* Until we have the summary we do not know whether there are
+	   groups; the summary is in the first block of a group if so.  */
+	if ( !grpsize && sumseen )
+		return	1;
+
+	if ( !grp_xor && !(grp_xor = calloc (1, blocksize)) )
+		{
+		fprintf (stderr, "out of memory\n");
+		exit (1);
+		}
+
+	xor_block (grp_xor + BBH$K_SZ, blk + BBH$K_SZ, blocksize - BBH$K_SZ);
+	grp_count++;
+
+	if ( !grp_lost )
+		return	1;
+
+	group_hold (blk, off, 0);
+	return	0;
+}
+
+/*
+ *  End of a saveset: whatever is held back goes out, and block numbers
+ *  start again.
+ */
+void	group_done	(void)
+{
+	if ( grp_lost )
+		fprintf (stderr, "%d block(s) of the last redundancy group lost, cannot rebuild\n", grp_lost);
+
+	group_flush (1);
+	lastnum = sumseen = 0;
+}
+
+/*
+ *  Can the data block BBH of LEN bytes be passed over without checking
+ *  or decoding it?  It can when no file is open (the current file is not
+ *  wanted, or we are only listing), its header names the current file,
+ *  and what is left of that file from the VBN of its first record fills
+ *  the block: then it holds nothing but data of the current file, and
+ *  no file header.  This takes a look at the block header and one record
+ *  header only, not at the data.  With --crc verify every block is to be
+ *  checked, so none is passed over.
+ */
+static int	blk_idle	(
+		BCK_BLK_HDR *	bbh,
+		unsigned	len
+			)
+{
+BCK_REC_HDR *	brh = (BCK_REC_HDR *) (bbh + 1);
+unsigned	n = bbh->t_filename [0];
+
+	if ( f || outpax || flag_index || !*filename || __cvt_uw (&bbh->w_applic) != 1
+			|| crcmode == CRC_K_VERIFY )
+		return	0;
+
+	if ( n >= sizeof (bbh->t_filename) || filename [n] || memcmp (bbh->t_filename + 1, filename, n) )
+		return	0;
+
+	if ( __cvt_uw (&brh->w_rtype) != brh_dol_k_vbn || !__cvt_ul (&brh->l_address) )
+		return	0;
+
+	/* The header is all we trust of it.  */
+	if ( crcmode != CRC_K_SKIP && bbh_check ((unsigned char *) bbh) )
+		return	0;
+
+	return	filesize - ((long) __cvt_ul (&brh->l_address) - 1) * 512
+		>= (long) (len - sizeof (BCK_BLK_HDR) - sizeof (BCK_REC_HDR));
 }
 
 /*
@@ -991,11 +1686,11 @@ void	process_block	(
 		int	buflen
 			)
 {
-unsigned short	bhsize, rsize, rtype;
-unsigned	bsize, i = 0;
+unsigned short	bhsize;
+unsigned	bsize;
 BCK_BLK_HDR *	bbh;
-BCK_REC_HDR *	brh;
 
+	blkoff = inp_tell (&input) - buflen;
 
 	/* read the backup block header */
 	bbh	= (BCK_BLK_HDR *) bufp;
@@ -1006,9 +1701,10 @@ BCK_REC_HDR *	brh;
 	if ( bhsize != sizeof(BCK_BLK_HDR) )
 		{
 		fprintf (stderr, "[0x%08X] Invalid header block size: expected %d got 0x%x/%d\n",
-			lseek(input_fd, 0, SEEK_CUR) - blocksize, sizeof (BCK_BLK_HDR), bhsize, bhsize);
+			(unsigned) (inp_tell (&input) - blocksize), (int) sizeof (BCK_BLK_HDR), bhsize, bhsize);
 
-		scan_bbh (bufp);
+		group_lost ();
+		scan_bbh ();
 
 		return;
 		}
@@ -1016,23 +1712,64 @@ BCK_REC_HDR *	brh;
 	if ( bsize && bsize != buflen)
 		{
 		fprintf(stderr, "[0x%08X] Invalid block size got %d, expected 0x%x/%d\n",
-			lseek(input_fd, 0, SEEK_CUR) - blocksize, bsize, buflen, buflen);
+			(unsigned) (inp_tell (&input) - blocksize), bsize, buflen, buflen);
 
-		scan_bbh (bufp);
+		group_lost ();
+		scan_bbh ();
 
 		return;
 		}
 
-	if ( bbh->w_applic == 2 )
+	/* A block we want nothing of still goes through the group, which
+	   may need its data to rebuild another: it is checked first, or a
+	   bad one would go into the rebuilding.  */
+	if ( blk_idle (bbh, buflen) )
+		{
+		skipped++;
+
+		if ( grpsize && blk_verify ((unsigned char *) bufp, buflen, blkoff) )
+			group_bad ((unsigned char *) bufp, blkoff);
+		else	group_take ((unsigned char *) bufp, blkoff);
+
 		return;
+		}
 
+	if ( blk_verify ((unsigned char *) bufp, buflen, blkoff) )
+		{
+		if ( __cvt_uw (&bbh->w_applic) == 2 )
+			group_end (NULL, blkoff);
+		else	group_bad ((unsigned char *) bufp, blkoff);
+
+		return;
+		}
 
 #ifdef	DEBUG
 	if (debugflag)
 		printf("[0x%08X] Backup block: header length = %d, size = %d, type (DATA=1/XOR=2) = %5d, csum = %x04\n",
-			lseek (fd, 0, SEEK_CUR), bhsize, bsize, bbh->w_applic, bbh->w_checksum);
+			(unsigned) (inp_tell (&input) - blocksize), bhsize, bsize, bbh->w_applic, bbh->w_checksum);
 #endif
 
+	if ( group_take ((unsigned char *) bufp, blkoff) )
+		decode_block (bufp, blkoff);
+}
+
+/*
+ *  Decode the records of the data block at BUFP, from offset OFF of the
+ *  saveset (-1 if it was rebuilt).
+ */
+static void	decode_block	(
+		char	*bufp,
+		off_t	off
+			)
+{
+unsigned short	rsize, rtype;
+unsigned	bsize, i = 0;
+BCK_BLK_HDR *	bbh = (BCK_BLK_HDR *) bufp;
+BCK_REC_HDR *	brh;
+char	*base = bufp;
+
+	bsize	= __cvt_ul (&bbh->l_blocksize);
+	blkoff	= off;
 
 	bufp += (i = sizeof(BCK_BLK_HDR));
 
@@ -1048,7 +1785,7 @@ BCK_REC_HDR *	brh;
 #ifdef	DEBUG
 		if (debugflag)
 			printf("+%06d: Record: type = 0x%x, size = %-5d, flags = 0x%x, addr = 0x%08x\n",
-				i, rtype, rsize, getu32 (brh->l_flags), getu32 (brh->l_address));
+				i, rtype, rsize, __cvt_ul (&brh->l_flags), __cvt_ul (&brh->l_address));
 #endif
 
 		bufp += sizeof(BCK_REC_HDR);
@@ -1064,6 +1801,7 @@ BCK_REC_HDR *	brh;
 					printf("rtype = Save Set summary\n");
 #endif
 
+				idx_addsummary (blkoff + (bufp - base), (unsigned char *) bufp, rsize);
 				process_summary (bufp, rsize);
 				break;
 
@@ -1074,6 +1812,7 @@ BCK_REC_HDR *	brh;
 #endif
 
 
+				idx_addfile ((unsigned char *) bufp, rsize);
 				process_file(bufp, rsize);
 				break;
 
@@ -1083,6 +1822,7 @@ BCK_REC_HDR *	brh;
 					printf("rtype = VBN\n");
 #endif
 
+				idx_addvbn (blkoff, bufp - base, rsize, __cvt_ul (&brh->l_address));
 				process_vbn(bufp, rsize);
 				break;
 
@@ -1137,12 +1877,12 @@ BCK_REC_HDR *	brh;
 int	rdhead	(void)
 {
 int i, nfound;
-char name[80];
+char name[80], *bufp;
 
 	nfound = 1;
 
 	/* read the tape label - 4 records of 80 bytes */
-	while ( (i = read(input_fd, label, LABEL_SIZE)) )
+	while ( (i = inp_read(&input, &bufp, LABEL_SIZE)) )
 		{
 		if ( i != LABEL_SIZE)
 			{
@@ -1150,9 +1890,12 @@ char name[80];
 			exit(1);
 			}
 
+		memcpy (label, bufp, LABEL_SIZE);
+
 		if ( !strncmp(label, "VOL1", 4) )
 			{
 			sscanf(label + 4, "%14s", name);
+			strcpy (volname, name);
 
 			if(vflag || tflag)
 				printf("Volume: %s\n",name);
@@ -1162,6 +1905,7 @@ char name[80];
 				{
 				sscanf(label+4, "%14s", name);
 				sscanf(label+31, "%4d", &setnr);
+				strcpy (setname, name);
 				}
 
 		/* get the block size */
@@ -1179,23 +1923,16 @@ char name[80];
 	if( (vflag || tflag) && !nfound )
 		printf("Saveset name: %s   number: %d\n", name, setnr);
 
-	/* get the block buffer */
-	if ( !(block = (char *) malloc(blocksize)) )
-		{
-		fprintf(stderr, "memory allocation for block failed\n");
-		exit(1);
-		}
-
 	return	nfound;
 }
 
 void	rdtail	(void)
 {
 int i;
-char name[80];
+char name[80], *bufp;
 
 	/* read the tape label - 4 records of 80 bytes */
-	while ( (i = read(input_fd, label, LABEL_SIZE)) )
+	while ( (i = inp_read(&input, &bufp, LABEL_SIZE)) )
 		{
 		if (i != LABEL_SIZE)
 			{
@@ -1203,6 +1940,8 @@ char name[80];
 			exit(1);
 			}
 
+		memcpy (label, bufp, LABEL_SIZE);
+
 		if ( !strncmp(label, "EOF1", 4) )
 			{
 			sscanf(label + 4, "%14s", name);
@@ -1213,6 +1952,282 @@ char name[80];
 		}
 }
 
+/*
+ *  Order names for tgt_wanted ().
+ */
+static int	tgt_cmp	(
+		const void *	a,
+		const void *	b
+			)
+{
+	return	strcmp (*(char **) a, *(char **) b);
+}
+
+/*
+ *  Is the file NAME one of those locate_start () chose?
+ */
+static int	tgt_wanted	(
+		char *	name
+			)
+{
+	return	NULL != bsearch (&name, tgt_names, tgt_nnames, sizeof (char *), tgt_cmp);
+}
+
+/*
+ *  Build the list of places to seek to for the files we want from the
+ *  catalogue entry of the current saveset.
+ */
+static void	locate_start	(void)
+{
+int	iter = 0;
+off_t	pos;
+char	*name;
+
+	tgt_n = tgt_next = tgt_nnames = 0;
+
+	while ( cat_nextfile (setnr, &iter, &pos, &name) )
+		{
+		if ( !selected ((unsigned char *) name) )
+			continue;
+
+		if ( !(tgt_names = realloc (tgt_names, (tgt_nnames + 1) * sizeof (char *))) )
+			{
+			fprintf (stderr, "out of memory\n");
+			exit (1);
+			}
+
+		tgt_names [tgt_nnames++] = name;
+
+		if ( tgt_n && tgt_pos [tgt_n - 1] == pos )
+			continue;
+
+		if ( tgt_n == tgt_alloc )
+			{
+			tgt_alloc = tgt_alloc ? 2 * tgt_alloc : 64;
+
+			if ( !(tgt_pos = realloc (tgt_pos, tgt_alloc * sizeof (off_t))) )
+				{
+				fprintf (stderr, "out of memory\n");
+				exit (1);
+				}
+			}
+
+		tgt_pos [tgt_n++] = pos;
+		}
+
+	qsort (tgt_names, tgt_nnames, sizeof (char *), tgt_cmp);
+	sel_restart ();
+
+	if ( vflag )
+		printf ("Locating %d block(s) from the catalogue\n", tgt_n);
+
+	locating = want_next = 1;
+	sel_seen = 0;
+}
+
+/*
+ *  Done with the current target: seek to the next one we have not
+ *  already read past.  Returns 1 if there are none left.
+ */
+static int	locate_next	(void)
+{
+off_t	here = inp_tapepos (&input);
+
+	while ( tgt_next < tgt_n && tgt_pos [tgt_next] < here )
+		tgt_next++;
+
+	if ( tgt_next == tgt_n )
+		{
+		locating = 0;
+		return	1;
+		}
+
+	if ( tgt_pos [tgt_next] != here && inp_tapeseek (&input, tgt_pos [tgt_next]) )
+		{
+		perror (tapefile);
+		exit (1);
+		}
+
+	tgt_next++;
+	want_next = sel_seen = 0;
+
+	return	0;
+}
+
+/*
+ *  Read the labels of the next saveset on tape and decide how to read
+ *  it: from the catalogue, or in full (recording it in the catalogue).
+ *  Returns nonzero at the end of the tape, like rdhead ().
+ */
+static int	newset	(void)
+{
+off_t	pos = inp_tapepos (&input);
+int	eoffl;
+
+	locating = recording = 0;
+
+	if ( (eoffl = rdhead ()) )
+		return	eoffl;
+
+	sel_restart ();
+	cat_volume (volname);
+
+	if ( sflag && setnr != selset )
+		return	0;
+
+	if ( sel_some () && cat_complete (setnr) )
+		locate_start ();
+	else if ( catalog && !cat_complete (setnr) )
+		{
+		cat_addset (setnr, setname, pos);
+		recording = 1;
+		}
+
+	return	0;
+}
+
+/*
+ *  List or extract a saveset on disk through its index: the file records
+ *  come from the index, and only the blocks with data of files we extract
+ *  are read from the saveset.
+ */
+static void	replay	(void)
+{
+unsigned char	*p;
+char	*block;
+size_t	len;
+off_t	off, cur = -1;
+int	n, k, nrange, recoff, rlen, drop = 0;
+
+	if ( (p = idx_summary (&len)) && len )
+		process_summary (p, len);
+
+	for (n = 0; n < idx_nfiles (); n++)
+		{
+		p = idx_file (n, &len, &nrange);
+		process_file (p, len);
+
+		for (k = 0; (f || outpax) && k < nrange; k++)
+			{
+			idx_range (n, k, &off, &recoff, &rlen);
+
+			if ( off != cur )
+				{
+				if ( blocksize != inp_pread (&input, &block, blocksize, off) )
+					{
+					fprintf (stderr, "[0x%08X] error reading block listed in the index\n", (unsigned) off);
+					exit (1);
+					}
+
+				cur = off;
+				/* No group to rebuild it from here.  */
+				drop = blk_verify ((unsigned char *) block, blocksize, off)
+					&& crcmode == CRC_K_VERIFY;
+				}
+
+			if ( !drop )
+				process_vbn ((unsigned char *) block + recoff, rlen);
+			}
+		}
+}
+
+/*
+ *  List or extract a saveset on disk from the N blocks at offsets OFFS,
+ *  from its block map.  Blocks missing from the map count as lost, to be
+ *  rebuilt from their redundancy group if they can be.  Data blocks are
+ *  numbered from 1, GRPSIZE to a group, so the number of a missing block
+ *  says which group lost it; the XOR blocks end the groups in turn.
+ */
+static void	from_map	(
+		off_t *	offs,
+		int	n
+			)
+{
+BCK_BLK_HDR *	bbh;
+char	*block;
+unsigned	number, next = 1, lost, grp = 0, first, last;
+int	k, j;
+
+	for (k = 0; k < n; k++)
+		{
+		if ( 0 > inp_seek (&input, offs [k])
+			|| blocksize != inp_read (&input, &block, blocksize) )
+			{
+			fprintf (stderr, "[0x%08X] error reading block listed in the block map\n", (unsigned) offs [k]);
+			exit (1);
+			}
+
+		bbh = (BCK_BLK_HDR *) block;
+		number = __cvt_ul (&bbh->l_number);
+		lost = 0;
+
+		if ( __cvt_uw (&bbh->w_applic) == 2 )
+			{
+			/* The group may have lost its last blocks: those it
+			   has not had yet, up to the next data block there is
+			   (the last group of a saveset may be short).  */
+			for (j = k + 1; j < n; j++)
+				if ( blocksize == inp_pread (&input, &block, blocksize, offs [j])
+					&& __cvt_uw (&((BCK_BLK_HDR *) block)->w_applic) == 1 )
+					break;
+
+			if ( grpsize )
+				{
+				last = ++grp * grpsize;
+
+				if ( j < n && (number = __cvt_ul (&((BCK_BLK_HDR *) block)->l_number)) && number <= last )
+					last = number - 1;
+
+				if ( j < n && last >= next )
+					{
+					lost = last - next + 1;
+					next = last + 1;
+					}
+				}
+
+			/* Back to the XOR block.  */
+			inp_seek (&input, offs [k]);
+			inp_read (&input, &block, blocksize);
+			}
+		else if ( number )
+			{
+			if ( number > next )
+				{
+				fprintf (stderr, "[0x%08X] Block(s) %u to %u missing\n", (unsigned) offs [k], next, number - 1);
+
+				/* Those of this block's group; the rest went with
+				   groups before it.  */
+				first = grpsize ? (number - 1) / grpsize * grpsize + 1 : next;
+				lost = number - MAX (next, first);
+				}
+
+			if ( number >= next )
+				next = number + 1;
+
+			/* Past a group whose XOR block is missing too.  */
+			if ( grpsize && (number - 1) / grpsize > grp )
+				grp = (number - 1) / grpsize;
+			}
+
+		while ( lost-- )
+			group_lost ();
+
+		process_block (block, blocksize);
+		}
+}
+
+/*
+ *  Tapes can be stood in for by SIMH tape images, which we recognize
+ *  by name.
+ */
+static int	tapeimage	(
+		char *	name
+			)
+{
+size_t	len = strlen (name);
+
+	return	len > 4 && !strcasecmp (name + len - 4, ".tap");
+}
 
 /* Perform the actual operation.  The way this works is that main () parses
    the arguments, sets up the global variables like cflags, and calls us.
@@ -1220,15 +2235,27 @@ char name[80];
 void	vmsbackup	(void)
 {
 int	i, eoffl;
+char	*block;
+off_t	pos, *offs;
 
 /* Nonzero if we are reading from a saveset on disk (as
    created by the /SAVE_SET qualifier to BACKUP) rather than from
    a tape.  */
-int ondisk;
+int ondisk = 0;
 
 	if (tapefile == NULL)
 		tapefile = def_tapefile;
 
+	crc_init ();
+	sel_init ();
+
+	if ( flag_pax )
+		pax_start ();
+
+	/* Decoding into a mapping needs no writers.  */
+	if ( writers > 0 && xflag && !flag_mapout )
+		wrmode = !wr_start (writers, (size_t) writer_mem << 20);
+
 	/* open the tape file */
 	if ( 0 > (input_fd = open(tapefile, O_RDONLY)) )
 		{
@@ -1241,7 +2268,9 @@ int ondisk;
 	op.mt_op = MTREW;
 	op.mt_count = 1;
 
-	if ( 0 > (i = ioctl(input_fd, MTIOCTOP, &op)) )
+	if ( tapeimage (tapefile) )
+		;
+	else if ( 0 > (i = ioctl(input_fd, MTIOCTOP, &op)) )
 		{
 		if (errno == EINVAL || errno == ENOTTY)
 			ondisk = 1;
@@ -1254,6 +2283,8 @@ int ondisk;
 	ondisk = 1;
 #endif
 
+	nfiles = nblocks = 0;
+
 	if (ondisk)
 		{
 		/* process_block wants this to match the size which
@@ -1266,17 +2297,69 @@ int ondisk;
 		   RSTS/E save sets */
 		blocksize = 32256;
 #endif
-		if ( !(block = malloc (blocksize)) )
+		if ( flag_index )
+			idx_begin ();
+
+		if ( blockmap )
 			{
-			fprintf(stderr, "memory allocation for block failed\n");
-			exit(1);
+			if ( flag_carve && 0 > carve (tapefile, input_fd, blockmap, jobs) )
+				exit (1);
+
+			if ( 0 > (i = map_load (blockmap, &offs)) )
+				exit (1);
+
+			inp_open (&input, input_fd, INP_K_DISK, flag_mmap, 0, blocksize);
+			from_map (offs, i);
+			free (offs);
+			group_done ();
+			eoffl = 1;
 			}
+		else if ( !flag_index && idx_open (tapefile, input_fd) )
+			{
+			/* No read-ahead: we only read what we need.  */
+			inp_open (&input, input_fd, INP_K_DISK, flag_mmap, 0, blocksize);
+			replay ();
+			idx_close ();
+			eoffl = 1;
+			}
+		else	{
+			/* Threads reading ahead would only get in the way
+			   of the extraction threads.  */
+			i = jobs > 1 && xflag && !wflag && !flag_index;
+
+			inp_open (&input, input_fd, INP_K_DISK, flag_mmap, i ? 0 : readahead, blocksize);
+
+			if ( vflag && input.map )
+				printf ("Saveset mapped into memory, %lu bytes\n", (unsigned long) input.mapsz);
+
+			if ( i && 0 > par_extract (jobs) )
+				{
+				perror (tapefile);
+				exit (1);
+				}
 
-		eoffl = 0;
+			eoffl = 0;
+			}
 		}
-	else	eoffl = rdhead();
+	else	{
+		if ( blockmap )
+			{
+			fprintf (stderr, "%s: block maps are only for savesets on disk\n", tapefile);
+			exit (1);
+			}
 
-	nfiles = nblocks = 0;
+		/* Tape records are never larger than this, whatever HDR2
+		   will say the blocksize is.  */
+		i = MAX (blocksize, TAPE_MAXREC);
+
+		inp_open (&input, input_fd, tapeimage (tapefile) ? INP_K_IMAGE : INP_K_TAPE, 0,
+			(int) (((unsigned long long) tapebuffer << 20) / i), i);
+
+		if ( catalog && 0 > cat_load (catalog) )
+			exit (1);
+
+		eoffl = newset();
+		}
 
 	/* read the backup tape blocks until end of tape */
 	while ( !eoffl )
@@ -1288,24 +2371,44 @@ int ondisk;
 				fprintf(stderr, "-s not supported for disk savesets\n");
 				exit(1);
 				}
-#if HAVE_MT_IOCTLS
-			op.mt_op = MTFSF;
-			op.mt_count = 1;
 
-			if ( 0 > (i = ioctl(input_fd, MTIOCTOP, &op)) )
+			/* Go straight there if the catalogue knows where
+			   it is (and we have not been there yet).  */
+			if ( inp_tapepos (&input) < (pos = cat_setpos (selset))
+				&& !inp_tapeseek (&input, pos) )
+				{
+				eoffl = newset ();
+				continue;
+				}
+
+			if ( 0 > inp_skipfile (&input) )
 				{
 				perror(tapefile);
 				exit(1);
 				}
-#else
-			abort ();
-#endif
+
+			i = 0;
+			}
+		else if ( locating && want_next && locate_next () )
+			{
+			/* Nothing more we want in this saveset.  */
+			if ( 0 > inp_skipfile (&input) )
+				{
+				perror(tapefile);
+				exit(1);
+				}
+
 			i = 0;
 			}
-		else	i = read(input_fd, block, blocksize);
+		else	{
+			blkpos = inp_tapepos (&input);
+			i = inp_read(&input, &block, blocksize);
+			}
 
 		if ( !i )
 			{
+			group_done ();
+
 			if (ondisk)
 				{
 				/* No need to support multiple save sets.  */
@@ -1315,8 +2418,11 @@ int ondisk;
 				if ( vflag || tflag )
 					printf ("\nTotal of %u files, %lu blocks\n", nfiles, nblocks);
 
+				if ( recording )
+					cat_endset (setnr);
+
 				rdtail();
-				eoffl = rdhead();
+				eoffl = newset();
 				}
 			}
 		else if (i == -1)
@@ -1324,6 +2430,14 @@ int ondisk;
 			perror ("error reading saveset");
 			exit (1);
 			}
+		else if (i != blocksize && ondisk)
+			{
+			/* A damaged saveset may end in part of a block.  */
+			fprintf (stderr, "[0x%08X] Short block of %d bytes at the end of the saveset, ignored\n",
+				(unsigned) (inp_tell (&input) - i), i);
+			group_done ();
+			eoffl = 1;
+			}
 		else if (i != blocksize)
 			{
 			fprintf(stderr, "bad block read i = %d\n", i);
@@ -1335,42 +2449,53 @@ int ondisk;
 			}
 		}
 
+	if ( ondisk && flag_index && rebuilt )
+		fprintf (stderr, "Index not written: blocks had to be rebuilt\n");
+	else if ( ondisk && flag_index )
+		idx_save (tapefile, input_fd);
+
+	if ( rebuilt || dupblocks )
+		fprintf (stderr, "%lu block(s) rebuilt from redundancy groups, %lu duplicate(s) dropped\n",
+			rebuilt, dupblocks);
+
+	if ( crcerrs || sumerrs || (vflag && crcmode != CRC_K_SKIP) )
+		fprintf (stderr, "%lu block(s) failed the CRC check, %lu the header checksum\n",
+			crcerrs, sumerrs);
 
-	if ( vflag || tflag )
+	if ( vflag && skipped )
+		fprintf (stderr, "%lu data block(s) of files not wanted passed over\n", skipped);
+
+	if ( listfmt )
+		fmt_flush ();
+	else if ( vflag || tflag )
 		{
 		if (ondisk)
 			printf ("\nTotal of %u files, %u blocks\nEnd of save set\n", nfiles, nblocks);
 		else	printf("End of tape\n");
 		}
 
+	/* the last file extracted, and wait for the writers */
+	closefile ();
+	dir_close ();
+
+	if ( flag_pax )
+		pax_end ();
+
+	if ( wrmode )
+		wr_finish ();
+
 	/* close the tape */
-	close(input_fd);
+	inp_close(&input);
+
+	cat_save ();
 
 #ifdef	NEWD
 	/* close debug file */
 	fclose(lf);
 #endif
 
+	ms_done (nfiles, nblocks);
+
 	/* exit cleanly */
 	exit(0);
 }
-
-
-static void debug_dump(const unsigned char* buffer, int itmlen, int itmcode)
-{
-
-	if (!debugflag)
-		return;
-
-
-	/* reduce a maximum output size */
-	itmlen = itmlen > 128 ? 128 : itmlen;
-
-	printf("dsize = 0x%x/%d octets, dtype = 0x%x/%d, hex dump follows -----------\n ", itmlen, itmlen, itmcode, itmcode);
-
-	for (; itmlen; itmlen--, buffer++)
-		printf("%02x ", *buffer);
-
-	printf("\n");
-
-}
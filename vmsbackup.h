@@ -1,14 +1,203 @@
 /* Variables and functions exported from vmsbackup.c.  See vmsbackup.c
    for comments on each variable or function.  */
 
+#include	<sys/types.h>
+
+struct timespec;
+
 extern int	cflag, dflag, eflag, sflag, tflag, vflag, wflag, xflag, debugflag;
 extern int	flag_binary;
 extern int	flag_full;
+extern int	flag_mmap;
+extern int	flag_prealloc, flag_mapout;
+extern int	flag_sparse;
+extern int	writers, writer_mem;
+extern int	flag_index;
+extern int	jobs;
+extern int	parallel;
+extern int	crcmode;
+extern int	readahead;
+extern int	tapebuffer, lowwater, highwater;
 extern char *	tapefile;
 extern int	selset;
 extern int	blocksize;
 
+extern char *	catalog;
+extern char *	blockmap;
+extern int	flag_carve;
+extern char *	includefrom, *excludefrom;
+extern int	flag_vmsmatch;
+extern int	flag_pax;
+extern int	listfmt;
+
 extern void	vmsbackup (void);
+extern void	process_summary (unsigned char *bufp, size_t buflen);
+extern void	process_file (unsigned char *bufp, size_t buflen);
+extern void	process_vbn (unsigned char *buffer, size_t rsize);
+extern int	vbn_direct (int *sizep, int *crp);
+extern void	vbn_resume (off_t end);
+extern void	scan_bbh (void);
+extern void	out_times (struct timespec *ts);
+extern int	is_zero (unsigned char *p, size_t n);
+extern int	blk_verify (unsigned char *blk, int len, off_t off);
+extern int	group_take (unsigned char *blk, off_t off);
+extern unsigned	grpsize;
+
+/* Values of listfmt.  */
+#define	LIST_K_TEXT	0
+#define	LIST_K_JSONL	1
+#define	LIST_K_CSV	2
+
+/* Values of crcmode.  */
+#define	CRC_K_SKIP	0
+#define	CRC_K_WARN	1
+#define	CRC_K_VERIFY	2
 
 extern char **	gargv;
 extern int	goptind, gargc;
+
+/* Variables and functions exported from input.c.  */
+
+typedef struct __bck_input {
+	int		fd;		/* saveset file descriptor */
+	int		ondisk;		/* saveset is a file, not a tape */
+	int		image;		/* tape is a SIMH tape image file */
+
+	unsigned char *	map;		/* mapping of the whole saveset (-m) */
+	size_t		mapsz;
+
+	off_t		pos;		/* offset of the next byte we return */
+	off_t		tpos;		/* tape position, see inp_tapepos () */
+
+	char *		buf;		/* buffer for read () input */
+	int		bufsz;
+
+	struct __bck_ring *ring;	/* read-ahead thread (-r), or NULL */
+} BCK_INPUT;
+
+extern BCK_INPUT	input;
+
+/* Kinds of input for inp_open ().  */
+#define	INP_K_TAPE	0
+#define	INP_K_DISK	1
+#define	INP_K_IMAGE	2
+
+extern void	inp_open (BCK_INPUT *ip, int fd, int kind, int mapit,
+			int depth, int blksz);
+extern int	inp_read (BCK_INPUT *ip, char **bufp, int len);
+extern int	inp_skipfile (BCK_INPUT *ip);
+extern off_t	inp_tapepos (BCK_INPUT *ip);
+extern int	inp_tapeseek (BCK_INPUT *ip, off_t pos);
+extern off_t	inp_tell (BCK_INPUT *ip);
+extern int	inp_seek (BCK_INPUT *ip, off_t pos);
+extern int	inp_pread (BCK_INPUT *ip, char **bufp, int len, off_t off);
+extern void	inp_close (BCK_INPUT *ip);
+
+/* Variables and functions exported from catalog.c.  */
+
+extern int	cat_load (char *path);
+extern void	cat_volume (char *vol);
+extern off_t	cat_setpos (int setnr);
+extern int	cat_complete (int setnr);
+extern int	cat_nextfile (int setnr, int *iter, off_t *posp, char **namep);
+extern void	cat_addset (int setnr, char *name, off_t pos);
+extern void	cat_addfile (int setnr, off_t pos, char *name);
+extern void	cat_endset (int setnr);
+extern void	cat_save (void);
+
+/* Variables and functions exported from index.c.  */
+
+extern int	idx_open (char *saveset, int fd);
+extern unsigned char *	idx_summary (size_t *lenp);
+extern int	idx_nfiles (void);
+extern unsigned char *	idx_file (int n, size_t *lenp, int *nrangep);
+extern void	idx_range (int n, int k, off_t *blkoffp, int *recoffp, int *lenp);
+extern void	idx_close (void);
+extern void	idx_begin (void);
+extern void	idx_addsummary (off_t off, unsigned char *p, size_t len);
+extern void	idx_addfile (unsigned char *p, size_t len);
+extern void	idx_addvbn (off_t blkoff, int recoff, int len, unsigned vbn);
+extern void	idx_save (char *saveset, int fd);
+
+/* Variables and functions exported from extract.c.  */
+
+extern int	par_extract (int njobs);
+
+/* Variables and functions exported from carve.c.  */
+
+extern int	carve (char *image, int fd, char *map, int njobs);
+extern int	map_load (char *map, off_t **offsp);
+
+/* Variables and functions exported from dircache.c.  */
+
+extern FILE *	dir_fopen (char *path);
+extern void	dir_close (void);
+
+/* Variables and functions exported from writer.c.  */
+
+typedef struct __wr_file	WR_FILE;
+
+extern int	wr_start (int nthreads, size_t cap);
+extern WR_FILE *	wr_open (FILE *fp, char *name);
+extern void *	wr_alloc (size_t len);
+extern void	wr_write (WR_FILE *wf, off_t off, void *buf, size_t len, size_t size);
+extern void	wr_close (WR_FILE *wf, off_t len, struct timespec *times);
+extern void	wr_finish (void);
+
+/* Variables and functions exported from select.c.  */
+
+extern void	sel_init (void);
+extern int	sel_some (void);
+extern int	selected (unsigned char *fn);
+extern int	sel_type (unsigned char *fn);
+extern void	sel_restart (void);
+
+/* Variables and functions exported from multi.c.  */
+
+extern void	ms_add (char *name);
+extern int	ms_count (void);
+extern void	ms_done (unsigned nfiles, unsigned long nblocks);
+extern void	ms_run (void);
+extern int	ms_index (void);
+
+/* Variables and functions exported from pax.c.  */
+
+struct __vb_file;
+
+extern void	pax_start (void);
+extern void	pax_file (const struct __vb_file *fp, const char *name, int binary);
+extern void	pax_write (const unsigned char *p, size_t n);
+extern void	pax_drop (void);
+extern void	pax_close (void);
+extern void	pax_end (void);
+
+/* Variables and functions exported from format.c.  */
+
+extern const char *	fmt_rfm (int recfmt);
+extern const char *	fmt_org (int recfmt);
+extern char *	fmt_rat (char *buf, int recatt);
+extern void	fmt_file (const struct __vb_file *fp, unsigned blocks);
+extern void	fmt_flush (void);
+
+/* Variables and functions exported from vmstime.c.  */
+
+/* A VMS date in parts.  */
+typedef struct __vt_time {
+	int	year, month, day;	/* month 1 to 12 */
+	int	hour, minute, second, hundredth;
+} VT_TIME;
+
+extern int	vt_split (const unsigned char *q, VT_TIME *tp);
+extern int	vt_asc (const unsigned char *q, char *buf);
+extern int	vt_timespec (const unsigned char *q, struct timespec *ts);
+
+/* Variables and functions exported from crc.c.  */
+
+/* Failures reported by blk_check ().  */
+#define	BLK_M_CRC	1
+#define	BLK_M_CHECKSUM	2
+
+extern void	crc_init (void);
+extern unsigned	crc32_update (unsigned crc, unsigned char *p, size_t len);
+extern int	blk_check (unsigned char *blk, int len);
+extern int	bbh_check (unsigned char *blk);
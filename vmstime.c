@@ -0,0 +1,211 @@
+/*
+ *
+ *  Title:
+ *	VMS dates
+ *
+ *  Description:
+ *	The dates of a saveset are VMS quadwords: 100 ns units since
+ *	00:00 on 17-Nov-1858, in the local time of the system that wrote
+ *	them.  These turn them into their parts, into VMS ASCII
+ *	("17-NOV-1858 00:00:00.00", as $ASCTIM writes it) and into a Unix
+ *	timespec, without $ASCTIM or gmtime () and without allocating.
+ *
+ *	The time of day is arithmetic; the date takes a division-heavy
+ *	calendar computation, so the year, month and day of the days seen
+ *	last are kept in a small cache.  The dates of a saveset fall on
+ *	few days (all its backup dates on one or two), so with millions of
+ *	files the computation is all but never done.  The cache is not
+ *	locked: dates are converted by the decoding thread only.
+ *
+ *	A timespec takes the VMS local time as UTC, as the pax archive
+ *	does: it is what the clock on the VMS system said.
+ *
+ */
+
+#include	<stdio.h>
+#include	<string.h>
+#include	<time.h>
+
+#include	<sys/types.h>
+
+#include	"vmsbackup.h"
+
+/* 100 ns units in a second and a day.  */
+#define	VT_SEC		10000000LL
+#define	VT_DAY		(86400 * VT_SEC)
+
+/* The day of the Unix epoch, 1-Jan-1970, counted from 17-Nov-1858.  */
+#define	VT_EPOCHDAY	40587
+
+#define	VT_CACHE	64
+
+static struct {
+	long		days;		/* + 1; 0 if empty */
+	short		year;
+	char		month, day;
+} vt_cache [VT_CACHE];
+
+/*
+ *  The date DAYS days after 17-Nov-1858 into *TP (the Gregorian calendar
+ *  by way of 400 year eras of 146097 days, counted from 1-Mar so that
+ *  leap days come last).
+ */
+static void	vt_civil	(
+		long		days,
+		VT_TIME *	tp
+			)
+{
+long	z = days - VT_EPOCHDAY + 719468, era, doe, yoe, doy, mp;
+
+	era = (z >= 0 ? z : z - 146096) / 146097;
+	doe = z - era * 146097;
+	yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	mp = (5 * doy + 2) / 153;
+
+	tp->day = doy - (153 * mp + 2) / 5 + 1;
+	tp->month = mp < 10 ? mp + 3 : mp - 9;
+	tp->year = yoe + era * 400 + (tp->month <= 2);
+}
+
+/*
+ *  The quadword at Q as a number.
+ */
+static long long	vt_quad	(
+		const unsigned char *	q
+			)
+{
+long long	t = 0;
+int	i;
+
+	for (i = 7; i >= 0; i--)
+		t = t << 8 | q [i];
+
+	return	t;
+}
+
+/*
+ *  Split the VMS date at Q into *TP.  Returns 0 if it is not a date (a
+ *  negative quadword is a delta time).
+ */
+int	vt_split	(
+		const unsigned char *	q,
+		VT_TIME *		tp
+			)
+{
+long long	t = vt_quad (q), rem;
+long	days;
+int	k;
+
+	if ( t < 0 )
+		return	0;
+
+	days = t / VT_DAY;
+	rem = t % VT_DAY;
+
+	tp->hour = rem / (3600 * VT_SEC);
+	tp->minute = rem / (60 * VT_SEC) % 60;
+	tp->second = rem / VT_SEC % 60;
+	tp->hundredth = rem / (VT_SEC / 100) % 100;
+
+	k = days % VT_CACHE;
+
+	if ( vt_cache [k].days != days + 1 )
+		{
+		vt_civil (days, tp);
+		vt_cache [k].days = days + 1;
+		vt_cache [k].year = tp->year;
+		vt_cache [k].month = tp->month;
+		vt_cache [k].day = tp->day;
+		}
+	else	{
+		tp->year = vt_cache [k].year;
+		tp->month = vt_cache [k].month;
+		tp->day = vt_cache [k].day;
+		}
+
+	return	1;
+}
+
+/*
+ *  Two digits of N into P.
+ */
+static char *	vt_2	(
+		char *	p,
+		int	n
+			)
+{
+	*p++ = '0' + n / 10 % 10;
+	*p++ = '0' + n % 10;
+
+	return	p;
+}
+
+/*
+ *  The VMS date at Q in VMS ASCII into BUF, which takes 24 bytes.
+ *  Returns its length, 23, or 0 if it is not a date.
+ */
+int	vt_asc	(
+		const unsigned char *	q,
+		char *			buf
+			)
+{
+static const char	months [] = "JANFEBMARAPRMAYJUNJULAUGSEPOCTNOVDEC";
+VT_TIME	t;
+char	*p = buf;
+
+	if ( !vt_split (q, &t) )
+		return	0;
+
+	p = vt_2 (p, t.day);
+
+	if ( *buf == '0' )
+		*buf = ' ';
+
+	*p++ = '-';
+	memcpy (p, months + 3 * (t.month - 1), 3);
+	p += 3;
+	*p++ = '-';
+	p = vt_2 (vt_2 (p, t.year / 100), t.year);
+	*p++ = ' ';
+	p = vt_2 (p, t.hour);
+	*p++ = ':';
+	p = vt_2 (p, t.minute);
+	*p++ = ':';
+	p = vt_2 (p, t.second);
+	*p++ = '.';
+	p = vt_2 (p, t.hundredth);
+	*p = '\0';
+
+	return	p - buf;
+}
+
+/*
+ *  The VMS date at Q as a Unix time into *TS.  Returns 0 if it is not a
+ *  date.
+ */
+int	vt_timespec	(
+		const unsigned char *	q,
+		struct timespec *	ts
+			)
+{
+long long	t = vt_quad (q), s;
+long	frac;
+
+	if ( t < 0 )
+		return	0;
+
+	t -= (long long) VT_EPOCHDAY * VT_DAY;
+	s = t / VT_SEC;
+
+	if ( (frac = t % VT_SEC) < 0 )
+		{
+		frac += VT_SEC;
+		s--;
+		}
+
+	ts->tv_sec = s;
+	ts->tv_nsec = frac * 100;
+
+	return	1;
+}
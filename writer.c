@@ -0,0 +1,375 @@
+/*
+ *
+ *  Title:
+ *	Writer threads
+ *
+ *  Description:
+ *	With -W the decoding thread does not write the files it extracts
+ *	itself.  process_vbn () fills buffers, which go as (file, offset,
+ *	buffer) chunks on a queue to a few writer threads; these pwrite ()
+ *	them, and close the files (cutting them to their length first when
+ *	asked to) once the last of their chunks is written.  A close that
+ *	takes its time, as on network file systems where it flushes, then
+ *	holds up a writer and not the decoding.
+ *
+ *	Buffers are allocated through wr_alloc (), which waits while the
+ *	buffers allocated and not yet written would go over the memory cap
+ *	(--writer-memory): the decoding can only run that far ahead of the
+ *	writes.
+ *
+ */
+
+#ifdef HAVE_UNIXIO_H
+#include	<unixio.h>
+#else
+#include	<unistd.h>
+#include	<fcntl.h>
+#endif
+
+#include	<stdio.h>
+#include	<errno.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<time.h>
+
+#include	<sys/types.h>
+#ifndef	NO_UTIMENS
+#include	<sys/stat.h>
+#endif
+#ifndef	NO_THREADS
+#include	<pthread.h>
+#endif
+
+#include	"vmsbackup.h"
+
+/* A file being written: closed when the last reference goes, the one
+   of its opener (dropped by wr_close ()) or one of a chunk.  */
+struct __wr_file {
+	FILE *		fp;
+	char *		name;
+	int		refs;
+	off_t		len;		/* to ftruncate () to, or -1 */
+	struct timespec	times [2];	/* to futimens () it to */
+};
+
+typedef struct __wr_job {
+	struct __wr_job *	next;
+	WR_FILE *	wf;
+	off_t		off;
+	char *		buf;		/* NULL: close */
+	size_t		len;
+} WR_JOB;
+
+#ifndef	NO_THREADS
+static pthread_mutex_t	wr_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	wr_work = PTHREAD_COND_INITIALIZER,	/* to the writers */
+			wr_room = PTHREAD_COND_INITIALIZER;	/* to the decoder */
+static pthread_t	*wr_threads;
+#define	WR_LOCK()	pthread_mutex_lock (&wr_lock)
+#define	WR_UNLOCK()	pthread_mutex_unlock (&wr_lock)
+#else
+#define	WR_LOCK()
+#define	WR_UNLOCK()
+#endif
+
+static WR_JOB	*wr_head, **wr_tail = &wr_head;
+static int	wr_nthreads, wr_done;
+static size_t	wr_cap, wr_bytes;	/* memory cap, buffers allocated */
+static unsigned long	wr_waits;	/* times the decoder had to wait */
+
+/*
+ *  Drop a reference to WF; the last one closes it.
+ */
+static void	wr_unref	(
+		WR_FILE *	wf
+			)
+{
+int	last;
+
+	WR_LOCK ();
+	last = !--wf->refs;
+	WR_UNLOCK ();
+
+	if ( !last )
+		return;
+
+	if ( wf->len >= 0 && (fflush (wf->fp) || ftruncate (fileno (wf->fp), wf->len)) )
+		perror (wf->name);
+
+#ifndef	NO_UTIMENS
+	if ( futimens (fileno (wf->fp), wf->times) && vflag )
+		perror (wf->name);
+#endif
+
+	if ( fclose (wf->fp) )
+		perror (wf->name);
+
+	free (wf->name);
+	free (wf);
+}
+
+/*
+ *  Do the job JP: write its chunk, or drop its file.
+ */
+static void	wr_run	(
+		WR_JOB *	jp
+			)
+{
+char	*p;
+size_t	len;
+off_t	off;
+ssize_t	n;
+
+	for (p = jp->buf, len = jp->len, off = jp->off; p && len; p += n, len -= n, off += n)
+		if ( 0 > (n = pwrite (fileno (jp->wf->fp), p, len, off)) )
+			{
+			if ( errno == EINTR )
+				{
+				n = 0;
+				continue;
+				}
+
+			perror (jp->wf->name);
+			break;
+			}
+
+	if ( jp->buf )
+		{
+		free (jp->buf);
+
+		WR_LOCK ();
+		wr_bytes -= jp->len;
+#ifndef	NO_THREADS
+		pthread_cond_signal (&wr_room);
+#endif
+		WR_UNLOCK ();
+		}
+
+	wr_unref (jp->wf);
+	free (jp);
+}
+
+#ifndef	NO_THREADS
+static void *	wr_worker	(
+		void *	arg
+			)
+{
+WR_JOB	*jp;
+
+	for (;;)
+		{
+		WR_LOCK ();
+
+		while ( !wr_head && !wr_done )
+			pthread_cond_wait (&wr_work, &wr_lock);
+
+		if ( !(jp = wr_head) )
+			{
+			WR_UNLOCK ();
+			return	NULL;
+			}
+
+		if ( !(wr_head = jp->next) )
+			wr_tail = &wr_head;
+
+		WR_UNLOCK ();
+
+		wr_run (jp);
+		}
+}
+#endif
+
+/*
+ *  Queue a job for the writers (without them, do it now).
+ */
+static void	wr_queue	(
+		WR_FILE *	wf,
+		off_t		off,
+		char *		buf,
+		size_t		len
+			)
+{
+WR_JOB	*jp;
+
+	if ( !(jp = malloc (sizeof (WR_JOB))) )
+		{
+		fprintf (stderr, "out of memory\n");
+		exit (1);
+		}
+
+	jp->next = NULL;
+	jp->wf = wf;
+	jp->off = off;
+	jp->buf = buf;
+	jp->len = len;
+
+#ifndef	NO_THREADS
+	WR_LOCK ();
+	*wr_tail = jp;
+	wr_tail = &jp->next;
+	pthread_cond_signal (&wr_work);
+	WR_UNLOCK ();
+#else
+	wr_run (jp);
+#endif
+}
+
+/*
+ *  Start NTHREADS writer threads, which may have up to CAP bytes of
+ *  buffers waiting.  Returns -1 if they cannot be started.
+ */
+int	wr_start	(
+		int	nthreads,
+		size_t	cap
+			)
+{
+#ifndef	NO_THREADS
+int	i;
+
+	if ( !(wr_threads = calloc (nthreads, sizeof (pthread_t))) )
+		return	-1;
+
+	wr_cap = cap;
+
+	for (i = 0; i < nthreads; i++, wr_nthreads++)
+		if ( (errno = pthread_create (&wr_threads [i], NULL, wr_worker, NULL)) )
+			{
+			perror ("writer thread");
+
+			if ( !i )
+				return	-1;
+			break;
+			}
+
+	return	0;
+#else
+	return	-1;
+#endif
+}
+
+/*
+ *  Hand over the file FP, open for writing, to the writers.  NAME is
+ *  for messages.
+ */
+WR_FILE *	wr_open	(
+		FILE *	fp,
+		char *	name
+			)
+{
+WR_FILE	*wf;
+
+	if ( !(wf = malloc (sizeof (WR_FILE))) || !(wf->name = strdup (name)) )
+		{
+		fprintf (stderr, "out of memory\n");
+		exit (1);
+		}
+
+	wf->fp = fp;
+	wf->refs = 1;
+	wf->len = -1;
+
+	return	wf;
+}
+
+/*
+ *  A buffer of LEN bytes for wr_write (), when the memory cap allows.
+ */
+void *	wr_alloc	(
+		size_t	len
+			)
+{
+void	*p;
+
+	WR_LOCK ();
+
+#ifndef	NO_THREADS
+	if ( wr_bytes && wr_bytes + len > wr_cap )
+		{
+		wr_waits++;
+
+		while ( wr_bytes && wr_bytes + len > wr_cap )
+			pthread_cond_wait (&wr_room, &wr_lock);
+		}
+#endif
+
+	wr_bytes += len;
+	WR_UNLOCK ();
+
+	if ( !(p = malloc (len)) )
+		{
+		fprintf (stderr, "out of memory\n");
+		exit (1);
+		}
+
+	return	p;
+}
+
+/*
+ *  Write the first LEN bytes of BUF, SIZE bytes from wr_alloc (), at
+ *  offset OFF of WF.  BUF goes to the writers.
+ */
+void	wr_write	(
+		WR_FILE *	wf,
+		off_t		off,
+		void *		buf,
+		size_t		len,
+		size_t		size
+			)
+{
+	WR_LOCK ();
+
+	/* The memory cap counts what is written, not what was allocated.  */
+	wr_bytes -= size - len;
+#ifndef	NO_THREADS
+	if ( size != len )
+		pthread_cond_signal (&wr_room);
+#endif
+
+	wf->refs++;
+	WR_UNLOCK ();
+
+	wr_queue (wf, off, buf, len);
+}
+
+/*
+ *  Close WF when all that was written to it is, first cutting it to
+ *  LEN bytes unless LEN is -1 and giving it the TIMES (as futimens ()
+ *  takes them).
+ */
+void	wr_close	(
+		WR_FILE *	wf,
+		off_t		len,
+		struct timespec *	times
+			)
+{
+	wf->len = len;
+	wf->times [0] = times [0];
+	wf->times [1] = times [1];
+	wr_queue (wf, 0, NULL, 0);
+}
+
+/*
+ *  Wait for everything to be written and closed, and stop the writers.
+ */
+void	wr_finish	(void)
+{
+#ifndef	NO_THREADS
+int	i;
+
+	WR_LOCK ();
+	wr_done = 1;
+	pthread_cond_broadcast (&wr_work);
+	WR_UNLOCK ();
+
+	for (i = 0; i < wr_nthreads; i++)
+		pthread_join (wr_threads [i], NULL);
+
+	if ( vflag )
+		printf ("Writers: %d thread(s), decoder waited %lu time(s) for memory\n",
+			wr_nthreads, wr_waits);
+
+	free (wr_threads);
+	wr_threads = NULL;
+	wr_nthreads = wr_done = 0;
+#endif
+}